@@ -42,5 +42,14 @@ int main()
   Matrix<double> inv = a;
   calcInverse (inv);
   std::cout << "calcInverse(a) = " << inv << std::endl; 
+
+  // the same tridiagonal system without dense storage
+  Vector<double> sub(n), diag(n), super(n), x(n);
+  sub = -1.0;
+  diag = 2.0;
+  super = -1.0;
+  x = 1.0;
+  solveTridiagonal (sub, diag, super, x);
+  std::cout << "solve(a, 1) = " << x << std::endl;
   
 }
@@ -0,0 +1,235 @@
+#ifndef FILE_BANDED_HPP
+#define FILE_BANDED_HPP
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "vector.hpp"
+#include "matrix.hpp"
+
+
+namespace nanoblas
+{
+
+  /*
+    Square band matrix with kl sub- and ku super-diagonals in LAPACK
+    band layout (ColMajor):
+
+      A(i,j) = ab[(kl+ku+i-j) + j*ldab],   ldab = 2*kl+ku+1
+
+    The first kl rows of ab are left free for the fill-in of the
+    LU factorization (dgbtrf_).
+  */
+
+  template <typename T = double>
+  class BandMatrix
+  {
+    size_t m_n, m_kl, m_ku;
+    std::vector<T> m_data;
+
+  public:
+    BandMatrix (size_t n, size_t kl, size_t ku)
+      : m_n(n), m_kl(kl), m_ku(ku), m_data((2*kl+ku+1)*n, T(0)) { }
+
+    template <ORDERING ORD>
+    BandMatrix (MatrixView<T,ORD> A, size_t kl, size_t ku)
+      : BandMatrix(A.rows(), kl, ku)
+    {
+      for (size_t j = 0; j < m_n; j++)
+        for (size_t i = firstRow(j); i < nextRow(j); i++)
+          (*this)(i,j) = A(i,j);
+    }
+
+    size_t rows() const { return m_n; }
+    size_t cols() const { return m_n; }
+    size_t kl() const { return m_kl; }
+    size_t ku() const { return m_ku; }
+    size_t dist() const { return 2*m_kl+m_ku+1; }
+    T * data() { return m_data.data(); }
+    const T * data() const { return m_data.data(); }
+
+    // row range [firstRow(j), nextRow(j)) of the band in column j
+    size_t firstRow (size_t j) const { return (j > m_ku) ? j-m_ku : 0; }
+    size_t nextRow (size_t j) const { return std::min(m_n, j+m_kl+1); }
+    size_t firstCol (size_t i) const { return (i > m_kl) ? i-m_kl : 0; }
+    size_t nextCol (size_t i) const { return std::min(m_n, i+m_ku+1); }
+
+    // (i,j) must be within the band
+    T & operator() (size_t i, size_t j)
+    {
+      assert(i+m_ku >= j && j+m_kl >= i);
+      return m_data[(m_kl+m_ku+i-j) + j*dist()];
+    }
+    const T & operator() (size_t i, size_t j) const
+    {
+      assert(i+m_ku >= j && j+m_kl >= i);
+      return m_data[(m_kl+m_ku+i-j) + j*dist()];
+    }
+  };
+
+
+  // ************************* band matrix - vector product *******************
+
+  template <typename T, typename TV>
+  class MultBandMatVecExpr : public VecExpr<MultBandMatVecExpr<T,TV>>
+  {
+    const BandMatrix<T> & a;
+    TV x;
+  public:
+    MultBandMatVecExpr (const BandMatrix<T> & _a, TV _x) : a(_a), x(_x) { }
+    size_t size() const { return a.rows(); }
+
+    auto operator() (size_t i) const {
+      T sum = 0;
+      for (size_t j = a.firstCol(i); j < a.nextCol(i); j++)
+        sum += a(i,j) * x(j);
+      return sum;
+    }
+  };
+
+  template <typename T, typename TV>
+  auto operator* (const BandMatrix<T> & a, const VecExpr<TV> & x)
+  {
+    assert(a.cols() == x.size());
+    return MultBandMatVecExpr<T,TV>(a, x.derived());
+  }
+
+  // y = A x, rows distributed over the workers
+  template <typename T, typename TDX, typename TDY>
+  void MultBandMatVec_parallel (const BandMatrix<T> & a,
+                                VectorView<T,TDX> x, VectorView<T,TDY> y)
+  {
+    constexpr size_t GRAIN = 4096;
+    const size_t n = a.rows();
+    const size_t num_tasks = (n + GRAIN - 1) / GRAIN;
+
+    ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+    {
+      const size_t i1 = static_cast<size_t>(t) * GRAIN;
+      const size_t i2 = std::min(n, i1 + GRAIN);
+      for (size_t i = i1; i < i2; i++)
+        {
+          T sum = 0;
+          for (size_t j = a.firstCol(i); j < a.nextCol(i); j++)
+            sum += a(i,j) * x(j);
+          y(i) = sum;
+        }
+    });
+  }
+
+
+  // ************************* tridiagonal solvers *******************
+
+  /*
+    Thomas algorithm for the tridiagonal system
+
+      sub(i) x(i-1) + diag(i) x(i) + super(i) x(i+1) = d(i),
+
+    sub(0) and super(n-1) are not used. d is overwritten with x.
+    No pivoting, suitable for diagonally dominant or SPD systems.
+  */
+  template <typename T, typename TD1, typename TD2, typename TD3, typename TD4>
+  void solveTridiagonal (VectorView<T,TD1> sub, VectorView<T,TD2> diag,
+                         VectorView<T,TD3> super, VectorView<T,TD4> d)
+  {
+    const size_t n = diag.size();
+    if (n == 0) return;
+    Vector<T> cp(n);    // modified super-diagonal
+
+    T beta = diag(0);
+    if (beta == T(0))
+      throw std::runtime_error("solveTridiagonal: zero pivot 0");
+    cp(0) = (n > 1) ? super(0) / beta : T(0);
+    d(0) /= beta;
+    for (size_t i = 1; i < n; i++)
+      {
+        beta = diag(i) - sub(i) * cp(i-1);
+        if (beta == T(0))
+          throw std::runtime_error("solveTridiagonal: zero pivot " + std::to_string(i));
+        cp(i) = (i+1 < n) ? super(i) / beta : T(0);
+        d(i) = (d(i) - sub(i) * d(i-1)) / beta;
+      }
+    for (size_t i = n-1; i-- > 0; )
+      d(i) -= cp(i) * d(i+1);
+  }
+
+
+  /*
+    Parallel cyclic reduction for very long tridiagonal systems,
+    same arguments as solveTridiagonal.
+
+    Level s eliminates the unknowns i-s and i+s from the equations
+    i = 2s-1 (mod 2s), so that these only couple to i-2s and i+2s.
+    All equations of one level are independent and are distributed
+    over the workers; the back substitution runs the levels in
+    reverse order. Work is O(n), the depth is O(log n).
+  */
+  template <typename T, typename TD1, typename TD2, typename TD3, typename TD4>
+  void solveTridiagonalCR (VectorView<T,TD1> sub, VectorView<T,TD2> diag,
+                           VectorView<T,TD3> super, VectorView<T,TD4> d)
+  {
+    const size_t n = diag.size();
+    if (n == 0) return;
+
+    Vector<T> a(n), b(n), c(n), rhs(n);
+    a = sub; b = diag; c = super; rhs = d;
+    a(0) = 0;
+    c(n-1) = 0;
+
+    constexpr size_t GRAIN = 8192;
+    auto forLevel = [](size_t first, size_t next, size_t step, auto && func)
+    {
+      if (first >= next) return;
+      const size_t num = (next - first + step - 1) / step;
+      if (num <= GRAIN)
+        {
+          for (size_t i = first; i < next; i += step)
+            func(i);
+          return;
+        }
+      const size_t num_tasks = (num + GRAIN - 1) / GRAIN;
+      ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+      {
+        const size_t k1 = static_cast<size_t>(t) * GRAIN;
+        const size_t k2 = std::min(num, k1 + GRAIN);
+        for (size_t k = k1; k < k2; k++)
+          func(first + k*step);
+      });
+    };
+
+    // reduction
+    size_t s = 1;
+    for ( ; 2*s-1 < n; s *= 2)
+      forLevel (2*s-1, n, 2*s, [&](size_t i)
+      {
+        T alpha = -a(i) / b(i-s);
+        b(i) += alpha * c(i-s);
+        rhs(i) += alpha * rhs(i-s);
+        a(i) = alpha * a(i-s);
+        if (i+s < n)
+          {
+            T gamma = -c(i) / b(i+s);
+            b(i) += gamma * a(i+s);
+            rhs(i) += gamma * rhs(i+s);
+            c(i) = gamma * c(i+s);
+          }
+        else
+          c(i) = 0;
+      });
+
+    // back substitution
+    for ( ; s >= 1; s /= 2)
+      forLevel (s-1, n, 2*s, [&](size_t i)
+      {
+        T sum = rhs(i);
+        if (i >= s) sum -= a(i) * d(i-s);
+        if (i+s < n) sum -= c(i) * d(i+s);
+        d(i) = sum / b(i);
+      });
+  }
+
+}
+
+#endif
@@ -0,0 +1,250 @@
+#ifndef FILE_BATCHED_HPP
+#define FILE_BATCHED_HPP
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include "vector.hpp"
+#include "matrix.hpp"
+
+
+namespace nanoblas
+{
+
+  /*
+    LU factorization with partial pivoting for a batch of many small
+    n x n systems (n ~ 4 .. 32).
+
+    The matrices are stored interleaved in packs of W systems
+    (structure of arrays): entry (i,j) of the W systems of a pack are
+    consecutive in memory,
+
+      mem[ ((pack*n + i)*n + j)*W + lane ],
+
+    so every innermost loop runs over the lanes, i.e. over W different
+    systems, and is vectorized by the compiler like the AddMatMatKernel.
+    Pivot choices differ between lanes, row exchanges are done with
+    lane-wise selects.
+
+    The packs are distributed over the ASC_HPC workers. A singular
+    system does not stop the batch, its first zero pivot is recorded
+    in info(s) (1-based, as LAPACK), 0 means success.
+  */
+
+  template <typename T = double, size_t W = 4>
+  class BatchedLU
+  {
+    size_t m_n, m_batch, m_packs;
+    std::vector<T> mem;
+    std::vector<int> pivots;    // [pack][j][lane]
+    std::vector<int> m_info;    // [system]
+
+    static constexpr size_t GRAIN = 16;  // packs per task
+
+    T * pack (size_t p) { return mem.data() + p*m_n*m_n*W; }
+    const T * pack (size_t p) const { return mem.data() + p*m_n*m_n*W; }
+
+
+    static void factorPack (size_t n, T * a, int * piv, int * info)
+    {
+      auto A = [a,n] (size_t i, size_t j) { return a + (i*n+j)*W; };
+
+      for (size_t j = 0; j < n; j++)
+        {
+          // pivot search, separately in each lane
+          T maxv[W];
+          int p[W];
+          for (size_t l = 0; l < W; l++)
+            {
+              maxv[l] = std::abs(A(j,j)[l]);
+              p[l] = j;
+            }
+          for (size_t r = j+1; r < n; r++)
+            for (size_t l = 0; l < W; l++)
+              {
+                T v = std::abs(A(r,j)[l]);
+                bool larger = v > maxv[l];
+                maxv[l] = larger ? v : maxv[l];
+                p[l] = larger ? int(r) : p[l];
+              }
+
+          for (size_t l = 0; l < W; l++)
+            {
+              piv[j*W+l] = p[l];
+              if (maxv[l] == T(0) && info[l] == 0)
+                info[l] = j+1;
+            }
+
+          // lane-wise exchange of rows j and p
+          for (size_t r = j+1; r < n; r++)
+            {
+              bool any = false;
+              for (size_t l = 0; l < W; l++)
+                any |= (p[l] == int(r));
+              if (!any) continue;
+
+              for (size_t c = 0; c < n; c++)
+                {
+                  T * aj = A(j,c);
+                  T * ar = A(r,c);
+                  for (size_t l = 0; l < W; l++)
+                    {
+                      bool sw = p[l] == int(r);
+                      T vj = aj[l], vr = ar[l];
+                      aj[l] = sw ? vr : vj;
+                      ar[l] = sw ? vj : vr;
+                    }
+                }
+            }
+
+          // L column and rank-1 update of the trailing block
+          T inv[W];
+          for (size_t l = 0; l < W; l++)
+            inv[l] = (A(j,j)[l] != T(0)) ? T(1) / A(j,j)[l] : T(0);
+
+          for (size_t r = j+1; r < n; r++)
+            {
+              T * lr = A(r,j);
+              for (size_t l = 0; l < W; l++)
+                lr[l] *= inv[l];
+
+              for (size_t c = j+1; c < n; c++)
+                {
+                  T * arc = A(r,c);
+                  const T * ajc = A(j,c);
+                  for (size_t l = 0; l < W; l++)
+                    arc[l] -= lr[l] * ajc[l];
+                }
+            }
+        }
+    }
+
+
+    // b[i*W+lane] overwritten with the solution
+    static void solvePack (size_t n, const T * a, const int * piv, T * b)
+    {
+      auto A = [a,n] (size_t i, size_t j) { return a + (i*n+j)*W; };
+
+      for (size_t j = 0; j < n; j++)
+        for (size_t l = 0; l < W; l++)
+          std::swap (b[j*W+l], b[piv[j*W+l]*W+l]);
+
+      // L y = P b,  L unit lower
+      for (size_t i = 1; i < n; i++)
+        for (size_t k = 0; k < i; k++)
+          {
+            const T * aik = A(i,k);
+            for (size_t l = 0; l < W; l++)
+              b[i*W+l] -= aik[l] * b[k*W+l];
+          }
+
+      // U x = y
+      for (size_t i = n; i-- > 0; )
+        {
+          for (size_t k = i+1; k < n; k++)
+            {
+              const T * aik = A(i,k);
+              for (size_t l = 0; l < W; l++)
+                b[i*W+l] -= aik[l] * b[k*W+l];
+            }
+          const T * aii = A(i,i);
+          for (size_t l = 0; l < W; l++)
+            b[i*W+l] /= aii[l];
+        }
+    }
+
+
+  public:
+    BatchedLU (size_t n, size_t batch)
+      : m_n(n), m_batch(batch), m_packs((batch+W-1)/W),
+        mem(m_packs*n*n*W, T(0)), pivots(m_packs*n*W), m_info(m_packs*W, 0)
+    {
+      // padding lanes of the last pack hold identity matrices
+      for (size_t s = batch; s < m_packs*W; s++)
+        for (size_t i = 0; i < n; i++)
+          (*this)(s,i,i) = 1;
+    }
+
+    size_t size() const { return m_n; }
+    size_t batchSize() const { return m_batch; }
+
+    // entry (i,j) of system s in the interleaved storage
+    T & operator() (size_t s, size_t i, size_t j)
+    { return mem[((s/W*m_n + i)*m_n + j)*W + s%W]; }
+    const T & operator() (size_t s, size_t i, size_t j) const
+    { return mem[((s/W*m_n + i)*m_n + j)*W + s%W]; }
+
+    template <ORDERING ORD>
+    void set (size_t s, MatrixView<T,ORD> A)
+    {
+      for (size_t i = 0; i < m_n; i++)
+        for (size_t j = 0; j < m_n; j++)
+          (*this)(s,i,j) = A(i,j);
+    }
+
+    // system s is the n x n matrix at data + s*stride
+    template <ORDERING ORD = RowMajor>
+    void setStrided (T * data, size_t stride)
+    {
+      for (size_t s = 0; s < m_batch; s++)
+        set (s, MatrixView<T,ORD>(m_n, m_n, data + s*stride));
+    }
+
+    int info (size_t s) const { return m_info[s]; }
+
+    // LU factorization of all systems in place, in parallel over packs
+    void factor ()
+    {
+      std::fill (m_info.begin(), m_info.end(), 0);
+      const size_t num_tasks = (m_packs + GRAIN - 1) / GRAIN;
+      ASC_HPC::RunParallel(static_cast<int>(num_tasks), [this](int t, int /*ntasks*/)
+      {
+        const size_t p1 = static_cast<size_t>(t) * GRAIN;
+        const size_t p2 = std::min(m_packs, p1 + GRAIN);
+        for (size_t p = p1; p < p2; p++)
+          factorPack (m_n, pack(p), &pivots[p*m_n*W], &m_info[p*W]);
+      });
+    }
+
+    // column s of B (n x batch) overwritten with A_s^{-1} B(:,s)
+    template <ORDERING ORD>
+    void solve (MatrixView<T,ORD> B) const
+    {
+      if (B.rows() != m_n || B.cols() != m_batch)
+        throw std::invalid_argument("BatchedLU::solve: B must be n x batch");
+
+      const size_t num_tasks = (m_packs + GRAIN - 1) / GRAIN;
+      ASC_HPC::RunParallel(static_cast<int>(num_tasks), [this,B](int t, int /*ntasks*/) mutable
+      {
+        const size_t p1 = static_cast<size_t>(t) * GRAIN;
+        const size_t p2 = std::min(m_packs, p1 + GRAIN);
+        std::vector<T> b(m_n*W);
+        for (size_t p = p1; p < p2; p++)
+          {
+            const size_t s1 = p*W;
+            const size_t ns = std::min(W, m_batch - s1);
+            for (size_t i = 0; i < m_n; i++)
+              for (size_t l = 0; l < W; l++)
+                b[i*W+l] = (l < ns) ? B(i, s1+l) : T(0);
+
+            solvePack (m_n, pack(p), &pivots[p*m_n*W], b.data());
+
+            for (size_t i = 0; i < m_n; i++)
+              for (size_t l = 0; l < ns; l++)
+                B(i, s1+l) = b[i*W+l];
+          }
+      });
+    }
+
+    // right hand side of system s at b + s*stride
+    void solveStrided (T * b, size_t stride) const
+    {
+      solve (MatrixView<T,ColMajor>(m_n, m_batch, stride, b));
+    }
+  };
+
+}
+
+#endif
@@ -0,0 +1,287 @@
+#ifndef FILE_BLOCK_SPARSE_HPP
+#define FILE_BLOCK_SPARSE_HPP
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+#include "sparse.hpp"
+
+
+namespace nanoblas
+{
+
+  /*
+    Block sparse row storage (BSR) with dense BS x BS blocks:
+
+      block k of block row bi sits in block column colind[k],
+      k in [rowptr[bi], rowptr[bi+1]), block columns sorted ascending.
+      Its entries are values[k*BS*BS + r*BS + c]   (RowMajor).
+
+    One column index per block instead of one per entry, and the
+    block products below run with BS fixed at compile time, so the
+    loops over r and c are unrolled and the partial sums stay in
+    registers.
+  */
+
+  template <typename T = double, size_t BS = 3>
+  class BlockSparseMatrix
+  {
+    size_t m_brows, m_bcols;
+    std::vector<size_t> m_rowptr;
+    std::vector<size_t> m_colind;
+    std::vector<T> m_values;
+
+  public:
+    static constexpr size_t BLOCKSIZE = BS;
+
+    BlockSparseMatrix (size_t brows, size_t bcols, std::vector<size_t> rowptr,
+                       std::vector<size_t> colind, std::vector<T> values)
+      : m_brows(brows), m_bcols(bcols), m_rowptr(std::move(rowptr)),
+        m_colind(std::move(colind)), m_values(std::move(values))
+    {
+      if (m_rowptr.size() != brows+1 || m_colind.size() != m_rowptr.back()
+          || m_values.size() != BS*BS*m_colind.size())
+        throw std::invalid_argument("BlockSparseMatrix: inconsistent BSR arrays");
+    }
+
+    // every BS x BS block of A with at least one entry becomes a dense block
+    explicit BlockSparseMatrix (const SparseMatrix<T> & A)
+      : m_brows(A.rows()/BS), m_bcols(A.cols()/BS), m_rowptr(A.rows()/BS+1, 0)
+    {
+      if (A.rows() % BS != 0 || A.cols() % BS != 0)
+        throw std::invalid_argument("BlockSparseMatrix: dimensions must be multiples of the block size");
+
+      const auto & ind = A.colInd();
+      const auto & val = A.values();
+      std::vector<size_t> pos(m_bcols, SIZE_MAX);   // block column -> block number in current block row
+
+      for (size_t bi = 0; bi < m_brows; bi++)
+        {
+          const size_t first = m_colind.size();
+          for (size_t i = bi*BS; i < (bi+1)*BS; i++)
+            for (size_t k = A.first(i); k < A.next(i); k++)
+              if (pos[ind[k]/BS] == SIZE_MAX)
+                {
+                  pos[ind[k]/BS] = 0;
+                  m_colind.push_back(ind[k]/BS);
+                }
+          std::sort (m_colind.begin()+first, m_colind.end());
+          for (size_t k = first; k < m_colind.size(); k++)
+            pos[m_colind[k]] = k;
+
+          m_values.resize(BS*BS*m_colind.size(), T(0));
+          for (size_t i = bi*BS; i < (bi+1)*BS; i++)
+            for (size_t k = A.first(i); k < A.next(i); k++)
+              m_values[BS*BS*pos[ind[k]/BS] + (i-bi*BS)*BS + ind[k]%BS] = val[k];
+
+          for (size_t k = first; k < m_colind.size(); k++)
+            pos[m_colind[k]] = SIZE_MAX;
+          m_rowptr[bi+1] = m_colind.size();
+        }
+    }
+
+    size_t rows() const { return m_brows*BS; }
+    size_t cols() const { return m_bcols*BS; }
+    size_t blockRows() const { return m_brows; }
+    size_t blockCols() const { return m_bcols; }
+    size_t numBlocks() const { return m_colind.size(); }
+    size_t nnz() const { return BS*BS*m_colind.size(); }
+
+    const std::vector<size_t> & rowPtr() const { return m_rowptr; }
+    const std::vector<size_t> & colInd() const { return m_colind; }
+    const std::vector<T> & values() const { return m_values; }
+    std::vector<T> & values() { return m_values; }
+
+    // blocks of block row bi: [first(bi), next(bi))
+    size_t first (size_t bi) const { return m_rowptr[bi]; }
+    size_t next (size_t bi) const { return m_rowptr[bi+1]; }
+
+    const T * block (size_t k) const { return m_values.data() + BS*BS*k; }
+    T * block (size_t k) { return m_values.data() + BS*BS*k; }
+    MatrixView<T,RowMajor> blockView (size_t k) { return { BS, BS, block(k) }; }
+
+    // block row partition [part[t], part[t+1]) with about numBlocks()/num_parts blocks each
+    std::vector<size_t> balancedPartition (size_t num_parts) const
+    {
+      std::vector<size_t> part(num_parts+1);
+      part[0] = 0;
+      for (size_t t = 1; t < num_parts; t++)
+        {
+          size_t target = t * numBlocks() / num_parts;
+          part[t] = std::lower_bound(m_rowptr.begin(), m_rowptr.end(), target) - m_rowptr.begin();
+          part[t] = std::max(part[t-1], std::min(part[t], m_brows));
+        }
+      part[num_parts] = m_brows;
+      return part;
+    }
+
+    Matrix<T> toDense () const
+    {
+      Matrix<T> A(rows(), cols());
+      A = T(0);
+      for (size_t bi = 0; bi < m_brows; bi++)
+        for (size_t k = first(bi); k < next(bi); k++)
+          for (size_t r = 0; r < BS; r++)
+            for (size_t c = 0; c < BS; c++)
+              A(bi*BS+r, m_colind[k]*BS+c) = block(k)[r*BS+c];
+      return A;
+    }
+  };
+
+
+  // ************************* block kernels *******************
+
+  // acc += blk * x,  blk: BS x BS RowMajor
+  template <size_t BS, typename T>
+  inline void BlockMultAdd (const T * blk, const T * x, T * acc)
+  {
+    for (size_t r = 0; r < BS; r++)
+      {
+        T sum = acc[r];
+        for (size_t c = 0; c < BS; c++)
+          sum += blk[r*BS+c] * x[c];
+        acc[r] = sum;
+      }
+  }
+
+  // acc[r][w] += sum_c blk(r,c) * xb[c][w],  W right hand sides at once
+  template <size_t BS, size_t W, typename T>
+  inline void BlockMultAddMulti (const T * blk, const T (&xb)[BS][W], T (&acc)[BS][W])
+  {
+    for (size_t c = 0; c < BS; c++)
+      for (size_t r = 0; r < BS; r++)
+        {
+          T brc = blk[r*BS+c];
+          for (size_t w = 0; w < W; w++)
+            acc[r][w] += brc * xb[c][w];
+        }
+  }
+
+
+  // ************************* BSR matrix - vector product *******************
+
+  // y(block rows [b1, b2)) = A x
+  template <typename T, size_t BS, typename TDX, typename TDY>
+  void MultBlockSparseMatVecRows (const BlockSparseMatrix<T,BS> & a,
+                                  VectorView<T,TDX> x, VectorView<T,TDY> y,
+                                  size_t b1, size_t b2)
+  {
+    const auto & ind = a.colInd();
+    for (size_t bi = b1; bi < b2; bi++)
+      {
+        T acc[BS] = { };
+        for (size_t k = a.first(bi); k < a.next(bi); k++)
+          {
+            T xb[BS];
+            for (size_t c = 0; c < BS; c++)
+              xb[c] = x(ind[k]*BS+c);
+            BlockMultAdd<BS> (a.block(k), xb, acc);
+          }
+        for (size_t r = 0; r < BS; r++)
+          y(bi*BS+r) = acc[r];
+      }
+  }
+
+  // y = A x
+  template <typename T, size_t BS, typename TDX, typename TDY>
+  void MultBlockSparseMatVec (const BlockSparseMatrix<T,BS> & a,
+                              VectorView<T,TDX> x, VectorView<T,TDY> y)
+  {
+    assert(a.cols() == x.size() && a.rows() == y.size());
+    MultBlockSparseMatVecRows (a, x, y, 0, a.blockRows());
+  }
+
+  // y = A x, block row partitions balanced by their number of blocks
+  template <typename T, size_t BS, typename TDX, typename TDY>
+  void MultBlockSparseMatVec_parallel (const BlockSparseMatrix<T,BS> & a,
+                                       VectorView<T,TDX> x, VectorView<T,TDY> y)
+  {
+    assert(a.cols() == x.size() && a.rows() == y.size());
+    const size_t num_tasks = std::max<size_t>(1, a.nnz() / SPARSE_GRAIN);
+    auto part = a.balancedPartition(num_tasks);
+
+    ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+    {
+      MultBlockSparseMatVecRows (a, x, y, part[t], part[t+1]);
+    });
+  }
+
+
+  // ************************* BSR matrix - dense matrix product *******************
+
+  // Y(block rows [b1, b2), :) = A X, the columns of X in groups of W
+  template <typename T, size_t BS, ORDERING OX, ORDERING OY>
+  void MultBlockSparseMatMatRows (const BlockSparseMatrix<T,BS> & a,
+                                  MatrixView<T,OX> X, MatrixView<T,OY> Y,
+                                  size_t b1, size_t b2)
+  {
+    constexpr size_t W = 8;
+    const auto & ind = a.colInd();
+    const size_t ncols = X.cols();
+
+    for (size_t bi = b1; bi < b2; bi++)
+      {
+        size_t j0 = 0;
+        for ( ; j0+W <= ncols; j0 += W)
+          {
+            T acc[BS][W] = { };
+            for (size_t k = a.first(bi); k < a.next(bi); k++)
+              {
+                T xb[BS][W];
+                for (size_t c = 0; c < BS; c++)
+                  for (size_t w = 0; w < W; w++)
+                    xb[c][w] = X(ind[k]*BS+c, j0+w);
+                BlockMultAddMulti<BS,W> (a.block(k), xb, acc);
+              }
+            for (size_t r = 0; r < BS; r++)
+              for (size_t w = 0; w < W; w++)
+                Y(bi*BS+r, j0+w) = acc[r][w];
+          }
+
+        // remaining columns one by one
+        for ( ; j0 < ncols; j0++)
+          {
+            T acc[BS] = { };
+            for (size_t k = a.first(bi); k < a.next(bi); k++)
+              {
+                T xb[BS];
+                for (size_t c = 0; c < BS; c++)
+                  xb[c] = X(ind[k]*BS+c, j0);
+                BlockMultAdd<BS> (a.block(k), xb, acc);
+              }
+            for (size_t r = 0; r < BS; r++)
+              Y(bi*BS+r, j0) = acc[r];
+          }
+      }
+  }
+
+  // Y = A X
+  template <typename T, size_t BS, ORDERING OX, ORDERING OY>
+  void MultBlockSparseMatMat (const BlockSparseMatrix<T,BS> & a,
+                              MatrixView<T,OX> X, MatrixView<T,OY> Y)
+  {
+    assert(a.cols() == X.rows() && a.rows() == Y.rows() && X.cols() == Y.cols());
+    MultBlockSparseMatMatRows (a, X, Y, 0, a.blockRows());
+  }
+
+  // Y = A X, block row partitions balanced by their work
+  template <typename T, size_t BS, ORDERING OX, ORDERING OY>
+  void MultBlockSparseMatMat_parallel (const BlockSparseMatrix<T,BS> & a,
+                                       MatrixView<T,OX> X, MatrixView<T,OY> Y)
+  {
+    assert(a.cols() == X.rows() && a.rows() == Y.rows() && X.cols() == Y.cols());
+    const size_t work = a.nnz() * std::max<size_t>(1, X.cols());
+    const size_t num_tasks = std::max<size_t>(1, std::min(work / SPARSE_GRAIN, a.blockRows()));
+    auto part = a.balancedPartition(num_tasks);
+
+    ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+    {
+      MultBlockSparseMatMatRows (a, X, Y, part[t], part[t+1]);
+    });
+  }
+
+}
+
+#endif
@@ -0,0 +1,265 @@
+#ifndef FILE_CHOLESKY_HPP
+#define FILE_CHOLESKY_HPP
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+
+#include "vector.hpp"
+#include "matrix.hpp"
+#include "triangular.hpp"
+
+
+namespace nanoblas
+{
+
+  /*
+    Native blocked factorizations of symmetric matrices:
+
+      Cholesky:  A = L L^T      (A symmetric positive definite)
+      LDLT:      A = L D L^T    (L unit lower, no pivoting)
+
+    Both are right-looking: a panel of NB columns is factored,
+    and the trailing matrix is updated by GEMM calls (addMatMat).
+    Only the lower triangle of A is referenced.
+  */
+
+  constexpr size_t CHOLESKY_BLOCKSIZE = 96;
+
+
+  // A22 -= W * PT  on the lower block-trapezoid of A22,
+  // W:  (n2 x nb)  scaled panel,  PT: (nb x n2)  transposed panel
+  template <typename T>
+  void SymmetricTrailingUpdate (MatrixView<T,ColMajor> W,
+                                MatrixView<T,ColMajor> PT,
+                                MatrixView<T,ColMajor> A22)
+  {
+    const size_t n2 = A22.rows();
+    if (n2 == 0) return;
+
+    constexpr size_t GRAIN = CHOLESKY_BLOCKSIZE;
+    const size_t num_tasks = (n2 + GRAIN - 1) / GRAIN;
+
+    ASC_HPC::RunParallel(static_cast<int>(num_tasks),
+                         [=](int t, int /*ntasks*/)
+    {
+      const size_t c1 = static_cast<size_t>(t) * GRAIN;
+      const size_t c2 = std::min(n2, c1 + GRAIN);
+      // columns [c1,c2), rows from the diagonal down
+      addMatMat(W.rows(c1, n2), PT.cols(c1, c2), A22.rows(c1, n2).cols(c1, c2));
+    });
+  }
+
+
+
+  template <typename T = double>
+  class Cholesky
+  {
+    Matrix<T,ColMajor> L;
+
+  public:
+    template <ORDERING ORD>
+    Cholesky (MatrixView<T,ORD> A)
+      : L(A.rows(), A.cols())
+    {
+      if (A.rows() != A.cols())
+        throw std::invalid_argument("Cholesky: matrix must be square");
+      L = A;
+
+      const size_t n = L.rows();
+      for (size_t k1 = 0; k1 < n; k1 += CHOLESKY_BLOCKSIZE)
+        {
+          const size_t k2 = std::min(n, k1 + CHOLESKY_BLOCKSIZE);
+
+          // unblocked factorization of the panel columns [k1,k2)
+          for (size_t j = k1; j < k2; j++)
+            {
+              T djj = L(j,j);
+              for (size_t l = k1; l < j; l++)
+                djj -= L(j,l)*L(j,l);
+              if (!(djj > 0))
+                throw std::runtime_error("Cholesky: matrix not positive definite, pivot "
+                                         + std::to_string(j));
+              djj = std::sqrt(djj);
+              L(j,j) = djj;
+
+              for (size_t l = k1; l < j; l++)
+                {
+                  T ljl = L(j,l);
+                  for (size_t i = j+1; i < n; i++)
+                    L(i,j) -= L(i,l) * ljl;
+                }
+              T inv = 1.0 / djj;
+              for (size_t i = j+1; i < n; i++)
+                L(i,j) *= inv;
+            }
+
+          // A22 -= L21 * L21^T
+          const size_t n2 = n - k2;
+          if (n2 == 0) break;
+          auto L21 = L.rows(k2, n).cols(k1, k2);
+          Matrix<T,ColMajor> W(n2, k2-k1);
+          Matrix<T,ColMajor> PT(k2-k1, n2);
+          for (size_t l = 0; l < k2-k1; l++)
+            for (size_t i = 0; i < n2; i++)
+              {
+                W(i,l) = -L21(i,l);
+                PT(l,i) = L21(i,l);
+              }
+          SymmetricTrailingUpdate<T> (W, PT, L.rows(k2, n).cols(k2, n));
+        }
+
+      // clear the strict upper triangle
+      for (size_t j = 1; j < n; j++)
+        for (size_t i = 0; i < j; i++)
+          L(i,j) = 0;
+    }
+
+    size_t size() const { return L.rows(); }
+    MatrixView<T,ColMajor> LFactor() const { return L; }
+
+    // b overwritten with A^{-1} b
+    template <typename TDIST>
+    void solve (VectorView<T,TDIST> b) const
+    {
+      const size_t n = L.rows();
+      // L y = b
+      for (size_t j = 0; j < n; j++)
+        {
+          T xj = b(j) / L(j,j);
+          b(j) = xj;
+          for (size_t i = j+1; i < n; i++)
+            b(i) -= L(i,j) * xj;
+        }
+      // L^T x = y
+      for (size_t j = n; j-- > 0; )
+        {
+          T sum = b(j);
+          for (size_t i = j+1; i < n; i++)
+            sum -= L(i,j) * b(i);
+          b(j) = sum / L(j,j);
+        }
+    }
+
+    // all columns of b overwritten with A^{-1} b, blocked triangular solves,
+    // the L^T solve reads L in place
+    template <ORDERING OB>
+    void solve (MatrixView<T,OB> b) const
+    {
+      MatrixView<T,ColMajor> LV = L;
+      TriangularSolve<Lower> (LV, b);
+      TriangularSolve<Upper> (trans(LV), b);
+    }
+  };
+
+
+
+  template <typename T = double>
+  class LDLT
+  {
+    Matrix<T,ColMajor> L;   // unit lower factor, D stored on the diagonal
+
+  public:
+    template <ORDERING ORD>
+    LDLT (MatrixView<T,ORD> A)
+      : L(A.rows(), A.cols())
+    {
+      if (A.rows() != A.cols())
+        throw std::invalid_argument("LDLT: matrix must be square");
+      L = A;
+
+      const size_t n = L.rows();
+      Vector<T> work(CHOLESKY_BLOCKSIZE);   // L(j,l)*d(l) for the panel
+
+      for (size_t k1 = 0; k1 < n; k1 += CHOLESKY_BLOCKSIZE)
+        {
+          const size_t k2 = std::min(n, k1 + CHOLESKY_BLOCKSIZE);
+
+          // unblocked factorization of the panel columns [k1,k2)
+          for (size_t j = k1; j < k2; j++)
+            {
+              T dj = L(j,j);
+              for (size_t l = k1; l < j; l++)
+                {
+                  work(l-k1) = L(j,l) * L(l,l);
+                  dj -= L(j,l) * work(l-k1);
+                }
+              if (dj == T(0))
+                throw std::runtime_error("LDLT: zero pivot " + std::to_string(j));
+              L(j,j) = dj;
+
+              for (size_t l = k1; l < j; l++)
+                {
+                  T wl = work(l-k1);
+                  for (size_t i = j+1; i < n; i++)
+                    L(i,j) -= L(i,l) * wl;
+                }
+              T inv = 1.0 / dj;
+              for (size_t i = j+1; i < n; i++)
+                L(i,j) *= inv;
+            }
+
+          // A22 -= L21 * D1 * L21^T
+          const size_t n2 = n - k2;
+          if (n2 == 0) break;
+          auto L21 = L.rows(k2, n).cols(k1, k2);
+          Matrix<T,ColMajor> W(n2, k2-k1);
+          Matrix<T,ColMajor> PT(k2-k1, n2);
+          for (size_t l = 0; l < k2-k1; l++)
+            {
+              T dl = L(k1+l, k1+l);
+              for (size_t i = 0; i < n2; i++)
+                {
+                  W(i,l) = -L21(i,l) * dl;
+                  PT(l,i) = L21(i,l);
+                }
+            }
+          SymmetricTrailingUpdate<T> (W, PT, L.rows(k2, n).cols(k2, n));
+        }
+
+      for (size_t j = 1; j < n; j++)
+        for (size_t i = 0; i < j; i++)
+          L(i,j) = 0;
+    }
+
+    size_t size() const { return L.rows(); }
+    auto D() const { return L.diag(); }
+
+    // b overwritten with A^{-1} b
+    template <typename TDIST>
+    void solve (VectorView<T,TDIST> b) const
+    {
+      const size_t n = L.rows();
+      // L y = b
+      for (size_t j = 0; j < n; j++)
+        {
+          T xj = b(j);
+          for (size_t i = j+1; i < n; i++)
+            b(i) -= L(i,j) * xj;
+        }
+      // D z = y
+      for (size_t j = 0; j < n; j++)
+        b(j) /= L(j,j);
+      // L^T x = z
+      for (size_t j = n; j-- > 0; )
+        {
+          T sum = b(j);
+          for (size_t i = j+1; i < n; i++)
+            sum -= L(i,j) * b(i);
+          b(j) = sum;
+        }
+    }
+
+    // all columns of b overwritten with A^{-1} b
+    template <ORDERING OB>
+    void solve (MatrixView<T,OB> b) const
+    {
+      for (size_t j = 0; j < b.cols(); j++)
+        solve (b.col(j));
+    }
+  };
+
+}
+
+#endif
@@ -4,12 +4,62 @@
 #include <vector>
 #include <utility>
 #include <algorithm>
+#include <stdexcept>
+#include <cmath>
 
 
 #include <matrix.hpp>
 
 namespace nanoblas {
 
+  // number of pivots eliminated per panel
+  constexpr size_t GJ_BLOCKSIZE = 64;
+
+
+  /*
+    Delayed Gauss-Jordan update of the rows [first,next) which are
+    outside the panel rows [j1,j2):
+
+      A(r,:) = A(r,:) - A(r,J) * P,   A(r,J) = - A(r,J) * P(:,J)
+
+    where P = A(J,:) is the already eliminated panel. The product runs
+    through the GEMM kernel, the rows are distributed over the workers.
+  */
+  template <typename T>
+  void GaussJordanUpdate (MatrixView<T> mat, size_t j1, size_t j2,
+                          size_t first, size_t next)
+  {
+    if (next <= first) return;
+
+    constexpr size_t GRAIN = 48;
+    const size_t b = j2 - j1;
+    const size_t num_tasks = (next - first + GRAIN - 1) / GRAIN;
+
+    // ColMajor view of the panel: n x b
+    auto panel = trans(mat.rows(j1, j2));
+
+    ASC_HPC::RunParallel(static_cast<int>(num_tasks),
+                         [=](int t, int /*ntasks*/)
+    {
+      const size_t i1 = first + static_cast<size_t>(t) * GRAIN;
+      const size_t i2 = std::min(next, i1 + GRAIN);
+      auto rows = mat.rows(i1, i2);
+
+      // -A(r,J), and clear the pivot columns for the in-place update
+      Matrix<T> negX(i2 - i1, b);
+      for (size_t r = 0; r < rows.rows(); r++)
+        for (size_t c = 0; c < b; c++)
+          {
+            negX(r, c) = -rows(r, j1+c);
+            rows(r, j1+c) = 0;
+          }
+
+      // rows += negX * P,  computed as trans(rows) += trans(P) * trans(negX)
+      addMatMat(panel, trans(negX), trans(rows));
+    });
+  }
+
+
   template <typename T>  
   void calcInverse(MatrixView<T> mat) 
   {
@@ -21,53 +71,63 @@ namespace nanoblas {
     std::vector<int> p(n);   // pivot-permutation
     for (size_t j = 0; j < n; j++) p[j] = j;
 
-    for (size_t j = 0; j < n; j++)
+    for (size_t j1 = 0; j1 < n; j1 += GJ_BLOCKSIZE)
       {
-	// pivot search
-	double maxval = abs(mat(j,j));
-	size_t r = j;
-
-	for (size_t i = j+1; i < n; i++)
-	  if (abs (mat(j, i)) > maxval)
-	    {
-	      r = i;
-	      maxval = abs (mat(r, i));
-	    }
+        size_t j2 = std::min(n, j1 + GJ_BLOCKSIZE);
+
+        // unblocked elimination within the panel rows [j1,j2)
+        for (size_t j = j1; j < j2; j++)
+          {
+            // pivot search
+            double maxval = std::abs(mat(j,j));
+            size_t r = j;
+
+            for (size_t i = j+1; i < n; i++)
+              if (std::abs(mat(j, i)) > maxval)
+                {
+                  r = i;
+                  maxval = std::abs(mat(r, i));
+                }
       
-        double rest = 0.0;
-        for (size_t i = j+1; i < n; i++)
-          rest += abs(mat(r, i));
-	if (maxval < 1e-20*rest)
-          throw std::runtime_error("Inverse matrix: Matrix singular");
-
-
-	// exchange rows
-	if (r > j)
-	  {
-	    for (size_t k = 0; k < n; k++)
-	      std::swap (mat(k, j), mat(k, r));
-	    std::swap (p[j], p[r]);
-	  }
+            double rest = 0.0;
+            for (size_t i = j+1; i < n; i++)
+              rest += std::abs(mat(r, i));
+            if (maxval < 1e-20*rest)
+              throw std::runtime_error("Inverse matrix: Matrix singular");
+
+
+            // exchange columns, also for the rows with pending updates
+            if (r > j)
+              {
+                for (size_t k = 0; k < n; k++)
+                  std::swap (mat(k, j), mat(k, r));
+                std::swap (p[j], p[r]);
+              }
       
 
-	// transformation
+            // transformation
 	
-	T hr = 1.0 / mat(j,j);
-	for (size_t i = 0; i < n; i++)
-          mat(j,i) *= hr;
-	mat(j,j) = hr;
-
-	for (size_t k = 0; k < n; k++)
-	  if (k != j)
-	    {
-	      T help = mat(k,j);
-	      T h = help * hr;   
-
-	      for (size_t i = 0; i < n; i++)
-                mat(k,i) -= help * mat(j,i); 
-
-	      mat(k,j) = -h;
-	    }
+            T hr = 1.0 / mat(j,j);
+            for (size_t i = 0; i < n; i++)
+              mat(j,i) *= hr;
+            mat(j,j) = hr;
+
+            for (size_t k = j1; k < j2; k++)
+              if (k != j)
+                {
+                  T help = mat(k,j);
+                  T h = help * hr;   
+
+                  for (size_t i = 0; i < n; i++)
+                    mat(k,i) -= help * mat(j,i); 
+
+                  mat(k,j) = -h;
+                }
+          }
+
+        // apply the panel to all other rows
+        GaussJordanUpdate (mat, j1, j2, 0, j1);
+        GaussJordanUpdate (mat, j1, j2, j2, n);
       }
 
     // row exchange
@@ -84,5 +144,3 @@ namespace nanoblas {
 }
 
 #endif
-
-
@@ -0,0 +1,669 @@
+#ifndef FILE_KRYLOV_HPP
+#define FILE_KRYLOV_HPP
+
+#include <vector>
+#include <cmath>
+#include <type_traits>
+
+#include "vector.hpp"
+#include "matrix.hpp"
+
+
+namespace nanoblas
+{
+
+  /*
+    Iterative solvers for A x = b.
+
+    An operator A is one of
+      - a callable               A(x, y)       : y = A x
+      - an object with           A.apply(x, y) : y = A x
+      - anything with            y = A * x     (Matrix, SparseMatrix, ...)
+    A preconditioner M is an operator applying M^{-1}.
+
+    All work vectors are allocated once in the solver object. The
+    vector updates are fused with the following dot products, so that
+    every iteration passes over memory as few times as possible. For
+    long vectors the kernels are distributed over the workers, the
+    partial sums are added in a fixed order, so the results do not
+    depend on the schedule.
+  */
+
+  struct IdentityPreconditioner
+  {
+    template <typename T>
+    void apply (VectorView<T> x, VectorView<T> y) const { y = x; }
+  };
+
+  template <typename T, typename TA>
+  void ApplyOperator (const TA & A, VectorView<T> x, VectorView<T> y)
+  {
+    if constexpr (std::is_invocable_v<const TA&, VectorView<T>, VectorView<T>>)
+      A(x, y);
+    else if constexpr (requires { A.apply(x, y); })
+      A.apply(x, y);
+    else
+      y = A * x;
+  }
+
+
+  // vector entries handled by one task
+  constexpr size_t KRYLOV_GRAIN = 32768;
+
+  // func(i1, i2) on the chunks of [0, n)
+  template <typename FUNC>
+  void ParallelForRange (size_t n, FUNC && func)
+  {
+    const size_t num_tasks = std::max<size_t>(1, n / KRYLOV_GRAIN);
+    if (num_tasks == 1)
+      {
+        func(size_t(0), n);
+        return;
+      }
+    ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+    {
+      func(t*n/num_tasks, (t+1)*n/num_tasks);
+    });
+  }
+
+  // result[0..num) = sum over the chunks of func(i1, i2, partial), which adds to partial[0..num)
+  template <typename T, typename FUNC>
+  void ParallelSumRange (size_t n, size_t num, T * result, FUNC && func)
+  {
+    const size_t num_tasks = std::max<size_t>(1, n / KRYLOV_GRAIN);
+    std::vector<T> partial(num_tasks*num, T(0));
+    if (num_tasks == 1)
+      func(size_t(0), n, partial.data());
+    else
+      ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+      {
+        func(t*n/num_tasks, (t+1)*n/num_tasks, partial.data()+t*num);
+      });
+
+    for (size_t l = 0; l < num; l++)
+      {
+        T sum = 0;
+        for (size_t t = 0; t < num_tasks; t++)
+          sum += partial[t*num+l];
+        result[l] = sum;
+      }
+  }
+
+  template <typename T>
+  T ParallelDot (VectorView<T> a, VectorView<T> b)
+  {
+    T sum;
+    ParallelSumRange<T> (a.size(), 1, &sum, [&](size_t i1, size_t i2, T * s)
+    {
+      for (size_t i = i1; i < i2; i++)
+        s[0] += a(i)*b(i);
+    });
+    return sum;
+  }
+
+
+  // common parameters and convergence history of the solvers
+  template <typename T>
+  class KrylovSolverBase
+  {
+  protected:
+    size_t m_n;
+    double m_tol;
+    size_t m_maxit;
+    size_t m_its = 0;
+    double m_res = 0;
+    bool m_conv = false;
+
+    KrylovSolverBase (size_t n, double tol, size_t maxit)
+      : m_n(n), m_tol(tol), m_maxit(maxit) { }
+
+    // r = b - A x, returns |b|
+    template <typename TA>
+    double initialResidual (const TA & A, VectorView<T> b, VectorView<T> x, VectorView<T> r)
+    {
+      ApplyOperator (A, x, r);
+      double bb;
+      ParallelSumRange<double> (m_n, 1, &bb, [&](size_t i1, size_t i2, double * s)
+      {
+        for (size_t i = i1; i < i2; i++)
+          {
+            r(i) = b(i) - r(i);
+            s[0] += b(i)*b(i);
+          }
+      });
+      return std::sqrt(bb);
+    }
+
+  public:
+    // stop at |b - A x| <= tol |b|, recursively updated residual
+    void setTolerance (double tol) { m_tol = tol; }
+    void setMaxIterations (size_t maxit) { m_maxit = maxit; }
+    size_t iterations() const { return m_its; }
+    double residual() const { return m_res; }
+    bool converged() const { return m_conv; }
+  };
+
+
+  /*
+    (Preconditioned) conjugate gradients for symmetric positive
+    definite A and M. Without preconditioner one iteration is the
+    operator application, one dot product, and one fused pass
+    (x += alpha p, r -= alpha q, |r|^2) plus the update of p.
+  */
+  template <typename T = double>
+  class CGSolver : public KrylovSolverBase<T>
+  {
+    using BASE = KrylovSolverBase<T>;
+    using BASE::m_n, BASE::m_tol, BASE::m_maxit, BASE::m_its, BASE::m_res, BASE::m_conv;
+
+    Vector<T> r, z, p, q;
+
+  public:
+    CGSolver (size_t n, double tol = 1e-10, size_t maxit = 1000)
+      : BASE(n, tol, maxit), r(n), z(n), p(n), q(n) { }
+
+    // x: initial guess and solution, returns converged()
+    template <typename TA, typename TM = IdentityPreconditioner>
+    bool solve (const TA & A, VectorView<T> b, VectorView<T> x,
+                const TM & M = IdentityPreconditioner())
+    {
+      constexpr bool precond = !std::is_same_v<TM, IdentityPreconditioner>;
+      VectorView<T> zv = precond ? VectorView<T>(z) : VectorView<T>(r);
+
+      const double bnorm = this->initialResidual (A, b, x, r);
+      const double bound = m_tol * bnorm;
+      if constexpr (precond) ApplyOperator (M, VectorView<T>(r), zv);
+
+      T rz;
+      T rr_rz[2];
+      ParallelSumRange<T> (m_n, 2, rr_rz, [&](size_t i1, size_t i2, T * s)
+      {
+        for (size_t i = i1; i < i2; i++)
+          {
+            p(i) = zv(i);
+            s[0] += r(i)*r(i);
+            s[1] += r(i)*zv(i);
+          }
+      });
+      m_res = std::sqrt(rr_rz[0]);
+      rz = rr_rz[1];
+      m_its = 0;
+      m_conv = m_res <= bound;
+
+      while (!m_conv && m_its < m_maxit)
+        {
+          ApplyOperator (A, VectorView<T>(p), VectorView<T>(q));
+          const T alpha = rz / ParallelDot (VectorView<T>(p), VectorView<T>(q));
+
+          T rr;
+          ParallelSumRange<T> (m_n, 1, &rr, [&](size_t i1, size_t i2, T * s)
+          {
+            for (size_t i = i1; i < i2; i++)
+              {
+                x(i) += alpha * p(i);
+                r(i) -= alpha * q(i);
+                s[0] += r(i)*r(i);
+              }
+          });
+          m_its++;
+          m_res = std::sqrt(rr);
+          if (m_res <= bound)
+            {
+              m_conv = true;
+              break;
+            }
+
+          T rznew = rr;
+          if constexpr (precond)
+            {
+              ApplyOperator (M, VectorView<T>(r), zv);
+              rznew = ParallelDot (VectorView<T>(r), zv);
+            }
+          const T beta = rznew / rz;
+          rz = rznew;
+          ParallelForRange (m_n, [&](size_t i1, size_t i2)
+          {
+            for (size_t i = i1; i < i2; i++)
+              p(i) = zv(i) + beta * p(i);
+          });
+        }
+      return m_conv;
+    }
+  };
+
+
+  /*
+    Pipelined conjugate gradients (Ghysels, Vanroose 2014) for
+    symmetric positive definite A and M.
+
+    Mathematically equivalent to CGSolver, but with the recurrences
+    for s = A p, q = M^{-1} s, z = A q, w = A u, the two dot products
+    (r,u) and (w,u) of an iteration are independent of the operator
+    applications of the same iteration. They are accumulated in the
+    pass that updates all vectors, so an iteration is one application
+    of A and M and one fused pass with a single reduction, instead of
+    the two separate reductions of textbook CG.
+
+    The recursively updated residual may drift from b - A x for very
+    tight tolerances; converged() refers to the recursive residual.
+  */
+  template <typename T = double>
+  class PipelinedCGSolver : public KrylovSolverBase<T>
+  {
+    using BASE = KrylovSolverBase<T>;
+    using BASE::m_n, BASE::m_tol, BASE::m_maxit, BASE::m_its, BASE::m_res, BASE::m_conv;
+
+    Vector<T> r, u, w, m, nv, z, q, s, p;
+
+  public:
+    PipelinedCGSolver (size_t n, double tol = 1e-10, size_t maxit = 1000)
+      : BASE(n, tol, maxit), r(n), u(n), w(n), m(n), nv(n), z(n), q(n), s(n), p(n) { }
+
+    template <typename TA, typename TM = IdentityPreconditioner>
+    bool solve (const TA & A, VectorView<T> b, VectorView<T> x,
+                const TM & M = IdentityPreconditioner())
+    {
+      constexpr bool precond = !std::is_same_v<TM, IdentityPreconditioner>;
+      // without preconditioner u = r, m = w, q = s
+      VectorView<T> uv = precond ? VectorView<T>(u) : VectorView<T>(r);
+      VectorView<T> mv = precond ? VectorView<T>(m) : VectorView<T>(w);
+
+      const double bnorm = this->initialResidual (A, b, x, r);
+      const double bound = m_tol * bnorm;
+      if constexpr (precond) ApplyOperator (M, VectorView<T>(r), uv);
+      ApplyOperator (A, uv, VectorView<T>(w));
+
+      // dots[0] = (r,u), dots[1] = (w,u), dots[2] = (r,r)
+      T dots[3];
+      ParallelSumRange<T> (m_n, 3, dots, [&](size_t i1, size_t i2, T * sum)
+      {
+        for (size_t i = i1; i < i2; i++)
+          {
+            z(i) = q(i) = s(i) = p(i) = 0;
+            sum[0] += r(i)*uv(i);
+            sum[1] += w(i)*uv(i);
+            sum[2] += r(i)*r(i);
+          }
+      });
+
+      m_its = 0;
+      m_res = std::sqrt(dots[2]);
+      m_conv = m_res <= bound;
+      T gamma_old = 1, alpha_old = 1;
+
+      while (!m_conv && m_its < m_maxit)
+        {
+          const T gamma = dots[0], delta = dots[1];
+          if constexpr (precond) ApplyOperator (M, VectorView<T>(w), mv);
+          ApplyOperator (A, mv, VectorView<T>(nv));
+
+          T alpha, beta;
+          if (m_its == 0)
+            {
+              beta = 0;
+              alpha = gamma / delta;
+            }
+          else
+            {
+              beta = gamma / gamma_old;
+              alpha = gamma / (delta - beta * gamma / alpha_old);
+            }
+          gamma_old = gamma;
+          alpha_old = alpha;
+
+          ParallelSumRange<T> (m_n, 3, dots, [&](size_t i1, size_t i2, T * sum)
+          {
+            for (size_t i = i1; i < i2; i++)
+              {
+                T zi = nv(i) + beta * z(i);
+                T si = w(i) + beta * s(i);
+                T pi = uv(i) + beta * p(i);
+                z(i) = zi; s(i) = si; p(i) = pi;
+
+                x(i) += alpha * pi;
+                T ri = r(i) - alpha * si;
+                T wi = w(i) - alpha * zi;
+                T ui = ri;
+                if constexpr (precond)
+                  {
+                    T qi = mv(i) + beta * q(i);
+                    q(i) = qi;
+                    ui = u(i) - alpha * qi;
+                    u(i) = ui;
+                  }
+                r(i) = ri;
+                w(i) = wi;
+
+                sum[0] += ri*ui;
+                sum[1] += wi*ui;
+                sum[2] += ri*ri;
+              }
+          });
+
+          m_its++;
+          m_res = std::sqrt(dots[2]);
+          m_conv = m_res <= bound;
+        }
+      return m_conv;
+    }
+  };
+
+
+  /*
+    BiCGStab (van der Vorst) for non-symmetric A, right preconditioned.
+    The final update pass of an iteration computes x, r, |r|^2 and the
+    next (rhat, r) together.
+  */
+  template <typename T = double>
+  class BiCGStabSolver : public KrylovSolverBase<T>
+  {
+    using BASE = KrylovSolverBase<T>;
+    using BASE::m_n, BASE::m_tol, BASE::m_maxit, BASE::m_its, BASE::m_res, BASE::m_conv;
+
+    Vector<T> r, rhat, p, v, s, t, phat, shat;
+
+  public:
+    BiCGStabSolver (size_t n, double tol = 1e-10, size_t maxit = 1000)
+      : BASE(n, tol, maxit), r(n), rhat(n), p(n), v(n), s(n), t(n), phat(n), shat(n) { }
+
+    template <typename TA, typename TM = IdentityPreconditioner>
+    bool solve (const TA & A, VectorView<T> b, VectorView<T> x,
+                const TM & M = IdentityPreconditioner())
+    {
+      constexpr bool precond = !std::is_same_v<TM, IdentityPreconditioner>;
+      VectorView<T> phv = precond ? VectorView<T>(phat) : VectorView<T>(p);
+      VectorView<T> shv = precond ? VectorView<T>(shat) : VectorView<T>(s);
+
+      const double bnorm = this->initialResidual (A, b, x, r);
+      const double bound = m_tol * bnorm;
+
+      T rr_rho[2];
+      ParallelSumRange<T> (m_n, 2, rr_rho, [&](size_t i1, size_t i2, T * sum)
+      {
+        for (size_t i = i1; i < i2; i++)
+          {
+            rhat(i) = r(i);
+            p(i) = 0;
+            v(i) = 0;
+            sum[0] += r(i)*r(i);
+          }
+      });
+      rr_rho[1] = rr_rho[0];
+      m_res = std::sqrt(rr_rho[0]);
+      m_its = 0;
+      m_conv = m_res <= bound;
+
+      T rho_old = 1, alpha = 1, omega = 1;
+      while (!m_conv && m_its < m_maxit)
+        {
+          const T rho = rr_rho[1];
+          if (rho == T(0)) break;     // breakdown
+          const T beta = (rho / rho_old) * (alpha / omega);
+          rho_old = rho;
+
+          ParallelForRange (m_n, [&](size_t i1, size_t i2)
+          {
+            for (size_t i = i1; i < i2; i++)
+              p(i) = r(i) + beta * (p(i) - omega * v(i));
+          });
+          if constexpr (precond) ApplyOperator (M, VectorView<T>(p), phv);
+          ApplyOperator (A, phv, VectorView<T>(v));
+          alpha = rho / ParallelDot (VectorView<T>(rhat), VectorView<T>(v));
+
+          T ss;
+          ParallelSumRange<T> (m_n, 1, &ss, [&](size_t i1, size_t i2, T * sum)
+          {
+            for (size_t i = i1; i < i2; i++)
+              {
+                s(i) = r(i) - alpha * v(i);
+                sum[0] += s(i)*s(i);
+              }
+          });
+          m_its++;
+          if (std::sqrt(ss) <= bound)
+            {
+              ParallelForRange (m_n, [&](size_t i1, size_t i2)
+              {
+                for (size_t i = i1; i < i2; i++)
+                  x(i) += alpha * phv(i);
+              });
+              m_res = std::sqrt(ss);
+              m_conv = true;
+              break;
+            }
+
+          if constexpr (precond) ApplyOperator (M, VectorView<T>(s), shv);
+          ApplyOperator (A, shv, VectorView<T>(t));
+          T ts_tt[2];
+          ParallelSumRange<T> (m_n, 2, ts_tt, [&](size_t i1, size_t i2, T * sum)
+          {
+            for (size_t i = i1; i < i2; i++)
+              {
+                sum[0] += t(i)*s(i);
+                sum[1] += t(i)*t(i);
+              }
+          });
+          omega = (ts_tt[1] != T(0)) ? ts_tt[0] / ts_tt[1] : T(0);
+
+          ParallelSumRange<T> (m_n, 2, rr_rho, [&](size_t i1, size_t i2, T * sum)
+          {
+            for (size_t i = i1; i < i2; i++)
+              {
+                x(i) += alpha * phv(i) + omega * shv(i);
+                r(i) = s(i) - omega * t(i);
+                sum[0] += r(i)*r(i);
+                sum[1] += rhat(i)*r(i);
+              }
+          });
+          m_res = std::sqrt(rr_rho[0]);
+          m_conv = m_res <= bound;
+          if (omega == T(0)) break;   // breakdown
+        }
+      return m_conv;
+    }
+  };
+
+
+  /*
+    Restarted GMRES(m), right preconditioned. The Krylov basis is
+    orthogonalized by classical Gram-Schmidt with one
+    re-orthogonalization (CGS2): three passes over the basis per
+    iteration instead of the 2(j+1) passes of modified Gram-Schmidt,
+    with the same stability in practice. The least squares problem is
+    updated by Givens rotations.
+  */
+  template <typename T = double>
+  class GMRESSolver : public KrylovSolverBase<T>
+  {
+    using BASE = KrylovSolverBase<T>;
+    using BASE::m_n, BASE::m_tol, BASE::m_maxit, BASE::m_its, BASE::m_res, BASE::m_conv;
+
+    size_t m_restart;
+    std::vector<T> vmem;              // basis, n x (m+1), ColMajor
+    Vector<T> w, z;
+    Matrix<T,ColMajor> H;             // (m+1) x m Hessenberg matrix
+    std::vector<T> cs, sn, g, h, h2, hres;
+
+    VectorView<T> V (size_t j) { return VectorView<T>(m_n, vmem.data()+j*m_n); }
+
+    // w -= V(0..k) c, c = V(0..k)^T w beforehand; fused with the dot products of the result
+    void orthogonalize (size_t k, T * c, T * c2, T & ww)
+    {
+      // c = V^T w
+      ParallelSumRange<T> (m_n, k, c, [&](size_t i1, size_t i2, T * sum)
+      {
+        for (size_t l = 0; l < k; l++)
+          {
+            const T * vl = vmem.data()+l*m_n;
+            T s = 0;
+            for (size_t i = i1; i < i2; i++)
+              s += vl[i]*w(i);
+            sum[l] += s;
+          }
+      });
+
+      // w -= V c, c2 = V^T w
+      auto subtract = [&](const T * coef, T * dots, bool norm)
+      {
+        T * res = hres.data();
+        ParallelSumRange<T> (m_n, k+1, res, [&](size_t i1, size_t i2, T * sum)
+        {
+          for (size_t i = i1; i < i2; i++)
+            {
+              T wi = w(i);
+              for (size_t l = 0; l < k; l++)
+                wi -= coef[l] * vmem[l*m_n+i];
+              w(i) = wi;
+              if (norm)
+                sum[k] += wi*wi;
+              else
+                for (size_t l = 0; l < k; l++)
+                  sum[l] += vmem[l*m_n+i]*wi;
+            }
+        });
+        if (dots) for (size_t l = 0; l < k; l++) dots[l] = res[l];
+        return res[k];
+      };
+
+      subtract (c, c2, false);
+      ww = subtract (c2, nullptr, true);
+      for (size_t l = 0; l < k; l++)
+        c[l] += c2[l];
+    }
+
+  public:
+    GMRESSolver (size_t n, size_t restart = 30, double tol = 1e-10, size_t maxit = 1000)
+      : BASE(n, tol, maxit), m_restart(restart), vmem(n*(restart+1)), w(n), z(n),
+        H(restart+1, restart), cs(restart), sn(restart), g(restart+1), h(restart+1), h2(restart+1), hres(restart+2) { }
+
+    template <typename TA, typename TM = IdentityPreconditioner>
+    bool solve (const TA & A, VectorView<T> b, VectorView<T> x,
+                const TM & M = IdentityPreconditioner())
+    {
+      constexpr bool precond = !std::is_same_v<TM, IdentityPreconditioner>;
+      const size_t m = m_restart;
+
+      m_its = 0;
+      m_conv = false;
+      double bound = -1;
+
+      while (true)
+        {
+          // r = b - A x into V(0)
+          const double bnorm = this->initialResidual (A, b, x, V(0));
+          if (bound < 0) bound = m_tol * bnorm;
+          T beta = std::sqrt(ParallelDot (V(0), V(0)));
+          m_res = beta;
+          if (m_res <= bound) { m_conv = true; break; }
+          if (m_its >= m_maxit) break;
+
+          ParallelForRange (m_n, [&](size_t i1, size_t i2)
+          {
+            T * v0 = vmem.data();
+            for (size_t i = i1; i < i2; i++)
+              v0[i] /= beta;
+          });
+          std::fill (g.begin(), g.end(), T(0));
+          g[0] = beta;
+
+          size_t j = 0;
+          for ( ; j < m && m_its < m_maxit; j++)
+            {
+              if constexpr (precond)
+                {
+                  ApplyOperator (M, V(j), VectorView<T>(z));
+                  ApplyOperator (A, VectorView<T>(z), VectorView<T>(w));
+                }
+              else
+                ApplyOperator (A, V(j), VectorView<T>(w));
+
+              T ww;
+              orthogonalize (j+1, h.data(), h2.data(), ww);
+              h[j+1] = std::sqrt(ww);
+
+              if (h[j+1] != T(0))
+                {
+                  const T inv = T(1) / h[j+1];
+                  VectorView<T> vnext = V(j+1);
+                  ParallelForRange (m_n, [&](size_t i1, size_t i2)
+                  {
+                    for (size_t i = i1; i < i2; i++)
+                      vnext(i) = w(i) * inv;
+                  });
+                }
+
+              // previous rotations, new rotation
+              for (size_t l = 0; l < j; l++)
+                {
+                  T tmp = cs[l]*h[l] + sn[l]*h[l+1];
+                  h[l+1] = -sn[l]*h[l] + cs[l]*h[l+1];
+                  h[l] = tmp;
+                }
+              T rad = std::hypot(h[j], h[j+1]);
+              if (rad == T(0)) break;     // breakdown, A V(j) in span of V(0..j-1)
+              cs[j] = h[j]/rad;
+              sn[j] = h[j+1]/rad;
+              h[j] = rad;
+              h[j+1] = 0;
+              g[j+1] = -sn[j]*g[j];
+              g[j] = cs[j]*g[j];
+
+              for (size_t l = 0; l <= j; l++)
+                H(l,j) = h[l];
+
+              m_its++;
+              m_res = std::abs(g[j+1]);
+              if (m_res <= bound)
+                {
+                  j++;
+                  break;
+                }
+            }
+
+          // breakdown in the first step: A M^{-1} r = 0, a restart would repeat it
+          if (j == 0) break;
+
+          // y = H^{-1} g, overwrites g
+          for (size_t l = j; l-- > 0; )
+            {
+              T sum = g[l];
+              for (size_t c = l+1; c < j; c++)
+                sum -= H(l,c) * g[c];
+              g[l] = sum / H(l,l);
+            }
+
+          // x += M^{-1} V y
+          VectorView<T> u = precond ? VectorView<T>(w) : x;
+          ParallelForRange (m_n, [&](size_t i1, size_t i2)
+          {
+            for (size_t i = i1; i < i2; i++)
+              {
+                T sum = precond ? T(0) : u(i);
+                for (size_t l = 0; l < j; l++)
+                  sum += g[l] * vmem[l*m_n+i];
+                u(i) = sum;
+              }
+          });
+          if constexpr (precond)
+            {
+              ApplyOperator (M, VectorView<T>(w), VectorView<T>(z));
+              ParallelForRange (m_n, [&](size_t i1, size_t i2)
+              {
+                for (size_t i = i1; i < i2; i++)
+                  x(i) += z(i);
+              });
+            }
+
+          if (m_res <= bound)
+            {
+              m_conv = true;
+              break;
+            }
+        }
+      return m_conv;
+    }
+  };
+
+}
+
+#endif
@@ -4,9 +4,12 @@
 #include <iostream>
 #include <string>
 #include <algorithm>
+#include <vector>
+#include <stdexcept>
 
 #include "vector.hpp"
 #include "matrix.hpp"
+#include "banded.hpp"
 
 
 #include <complex>
@@ -118,11 +121,12 @@ namespace nanoblas
 
 
 
-  // c = a*b
+  // c = a*b + beta c
   template <typename T, ORDERING OA, ORDERING OB>
   void MultMatMatLapack (MatrixView<T, OA> a,
                          MatrixView<T, OB> b,
-                         MatrixView<T, ColMajor> c)
+                         MatrixView<T, ColMajor> c,
+                         double beta = 0)
   {
     char transa_ = (OA == ColMajor) ? 'N' : 'T';
     char transb_ = (OB == ColMajor) ? 'N' : 'T'; 
@@ -132,7 +136,6 @@ namespace nanoblas
     integer k = a.cols();
   
     double alpha = 1.0;
-    double beta = 0;
 
 
     //integer lda = std::max(a.dist(), 1ul);
@@ -153,14 +156,109 @@ namespace nanoblas
   template <ORDERING OA, ORDERING OB>
   void MultMatMatLapack (MatrixView<double, OA> a,
                          MatrixView<double, OB> b,
-                         MatrixView<double, RowMajor> c)
+                         MatrixView<double, RowMajor> c,
+                         double beta = 0)
   {
-    MultMatMatLapack (trans(b), trans(a), trans(c));
+    MultMatMatLapack (trans(b), trans(a), trans(c), beta);
   }
 
 
   
 
+  // int dsyrk_(char *uplo, char *trans, integer *n, integer *k,
+  //            doublereal *alpha, doublereal *a, integer *lda, doublereal *beta,
+  //            doublereal *c__, integer *ldc);
+
+  // c = a*a^T, lower triangle of c (and the upper one with mirror)
+  template <ORDERING OA, ORDERING OC>
+  void SymmetricRankKLapack (MatrixView<double,OA> a,
+                             MatrixView<double,OC> c, bool mirror = true)
+  {
+    // a RowMajor n x k is a ColMajor k x n for Fortran,
+    // the lower triangle of a RowMajor c is the upper one for Fortran
+    char uplo = (OC == ColMajor) ? 'L' : 'U';
+    char transa = (OA == ColMajor) ? 'N' : 'T';
+    integer n = c.rows();
+    integer k = a.cols();
+    if (n == 0) return;
+    double alpha = 1.0;
+    double beta = 0;
+    integer lda = std::max<integer>(static_cast<integer>(a.dist()), 1);
+    integer ldc = std::max<integer>(static_cast<integer>(c.dist()), 1);
+
+    int err = dsyrk_ (&uplo, &transa, &n, &k, &alpha, a.data(), &lda,
+                      &beta, c.data(), &ldc);
+    if (err != 0)
+      throw std::runtime_error(std::string("SymmetricRankKLapack got error "+std::to_string(err)));
+
+    if (mirror)
+      for (size_t j = 1; j < c.cols(); j++)
+        for (size_t i = 0; i < j; i++)
+          c(i,j) = c(j,i);
+  }
+
+
+  // int dger_(integer *m, integer *n, doublereal *alpha, doublereal *x,
+  //           integer *incx, doublereal *y, integer *incy, doublereal *a, integer *lda);
+
+  // a += alpha x y^T, a RowMajor a is updated as a^T += alpha y x^T
+  template <typename TDX, typename TDY, ORDERING ORD>
+  void RankOneUpdateLapack (double alpha, VectorView<double,TDX> x,
+                            VectorView<double,TDY> y, MatrixView<double,ORD> a)
+  {
+    if constexpr (ORD == RowMajor)
+      RankOneUpdateLapack (alpha, y, x, trans(a));
+    else
+      {
+        integer m = a.rows();
+        integer n = a.cols();
+        if (m == 0 || n == 0) return;
+        integer incx = static_cast<integer>(x.dist());
+        integer incy = static_cast<integer>(y.dist());
+        integer lda = std::max<integer>(static_cast<integer>(a.dist()), 1);
+
+        int err = dger_ (&m, &n, &alpha, x.data(), &incx, y.data(), &incy, a.data(), &lda);
+        if (err != 0)
+          throw std::runtime_error(std::string("RankOneUpdateLapack got error "+std::to_string(err)));
+      }
+  }
+
+
+  // Calls f(b, nrhs, ldb) with the right hand sides stored ColMajor.
+  // Strided vectors and RowMajor matrices are copied into a temporary.
+  template <typename TDIST, typename FUNC>
+  void CallWithColMajorRHS (VectorView<double,TDIST> b, FUNC f)
+  {
+    integer n = b.size();
+    if (b.dist() == 1)
+      {
+        f(b.data(), 1, std::max<integer>(n, 1));
+        return;
+      }
+    Vector<double> tmp(b.size());
+    tmp = b;
+    f(tmp.data(), 1, std::max<integer>(n, 1));
+    b = tmp;
+  }
+
+  template <ORDERING OB, typename FUNC>
+  void CallWithColMajorRHS (MatrixView<double,OB> b, FUNC f)
+  {
+    integer n = b.rows();
+    integer nrhs = b.cols();
+    if constexpr (OB == ColMajor)
+      f(b.data(), nrhs, std::max<integer>(static_cast<integer>(b.dist()), 1));
+    else
+      {
+        Matrix<double,ColMajor> tmp(b.rows(), b.cols());
+        tmp = b;
+        f(tmp.data(), nrhs, std::max<integer>(n, 1));
+        b = tmp;
+      }
+  }
+
+
+
   template <ORDERING ORD>
   class LapackLU {
     Matrix <double, ORD> a;
@@ -182,19 +280,44 @@ namespace nanoblas
     }
     
     // b overwritten with A^{-1} b
-    void solve (VectorView<double> b) const {
-      char transa =  (ORD == ColMajor) ? 'N' : 'T';
-      integer n = a.rows();
-      integer nrhs = 1;
-      integer lda = a.dist();
-      integer ldb = b.size();
-      integer info;
+    template <typename TDIST>
+    void solve (VectorView<double,TDIST> b) const {
+      CallWithColMajorRHS (b, [this](double * pb, integer nrhs, integer ldb)
+                           { solveColMajor (false, pb, nrhs, ldb); });
+    }
 
-      // int dgetrs_(char *trans, integer *n, integer *nrhs, 
-      //             doublereal *a, integer *lda, integer *ipiv,
-      //             doublereal *b, integer *ldb, integer *info);
+    // all columns of b overwritten with A^{-1} b
+    template <ORDERING OB>
+    void solve (MatrixView<double,OB> b) const {
+      CallWithColMajorRHS (b, [this](double * pb, integer nrhs, integer ldb)
+                           { solveColMajor (false, pb, nrhs, ldb); });
+    }
+
+    // x = A^{-1} b, b is not modified
+    template <typename TB, typename TX>
+    void solve (const TB & b, TX && x) const {
+      x = b;
+      solve (x);
+    }
+
+    // b overwritten with A^{-T} b
+    template <typename TDIST>
+    void solveTrans (VectorView<double,TDIST> b) const {
+      CallWithColMajorRHS (b, [this](double * pb, integer nrhs, integer ldb)
+                           { solveColMajor (true, pb, nrhs, ldb); });
+    }
 
-      dgetrs_(&transa, &n, &nrhs, a.data(), &lda, (integer*)ipiv.data(), b.data(), &ldb, &info);
+    template <ORDERING OB>
+    void solveTrans (MatrixView<double,OB> b) const {
+      CallWithColMajorRHS (b, [this](double * pb, integer nrhs, integer ldb)
+                           { solveColMajor (true, pb, nrhs, ldb); });
+    }
+
+    // x = A^{-T} b, b is not modified
+    template <typename TB, typename TX>
+    void solveTrans (const TB & b, TX && x) const {
+      x = b;
+      solveTrans (x);
     }
   
     Matrix<double,ORD> inverse() && {
@@ -219,6 +342,565 @@ namespace nanoblas
     // Matrix<double,ORD> LFactor() const { ... }
     // Matrix<double,ORD> UFactor() const { ... }
     // Matrix<double,ORD> PFactor() const { ... }
+
+  private:
+    // right hand side blocks wider than this are split over the workers
+    static constexpr integer PARALLEL_RHS_CHUNK = 32;
+
+    void solveColMajor (bool transposed, double * pb, integer nrhs, integer ldb) const {
+      // a RowMajor factor is the LU factorization of A^T
+      char transa = ((ORD == ColMajor) != transposed) ? 'N' : 'T';
+      integer n = a.rows();
+      if (n == 0 || nrhs == 0) return;
+      integer lda = a.dist();
+
+      // int dgetrs_(char *trans, integer *n, integer *nrhs, 
+      //             doublereal *a, integer *lda, integer *ipiv,
+      //             doublereal *b, integer *ldb, integer *info);
+
+      if (nrhs <= PARALLEL_RHS_CHUNK)
+        {
+          integer info;
+          dgetrs_(&transa, &n, &nrhs, a.data(), &lda, (integer*)ipiv.data(), pb, &ldb, &info);
+          return;
+        }
+
+      const integer num_tasks = (nrhs + PARALLEL_RHS_CHUNK - 1) / PARALLEL_RHS_CHUNK;
+      ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+      {
+        integer first = t * PARALLEL_RHS_CHUNK;
+        integer nrhs_t = std::min(nrhs, first + PARALLEL_RHS_CHUNK) - first;
+        char transa_t = transa;
+        integer n_t = n, lda_t = lda, ldb_t = ldb;
+        integer info;
+        dgetrs_(&transa_t, &n_t, &nrhs_t, a.data(), &lda_t, (integer*)ipiv.data(),
+                pb + size_t(first)*ldb, &ldb_t, &info);
+      });
+    }
+  };
+
+
+  // Cholesky factorization A = L L^T of a symmetric positive definite matrix.
+  // Only the lower triangle of A is referenced.
+  template <ORDERING ORD>
+  class LapackCholesky {
+    Matrix <double, ORD> a;
+    // the lower triangle of a RowMajor matrix is the upper one for Fortran
+    static constexpr char uplo = (ORD == ColMajor) ? 'L' : 'U';
+    
+  public:
+    LapackCholesky (Matrix<double,ORD> _a)
+      : a(std::move(_a)) {
+      char uplo_ = uplo;
+      integer n = a.rows();
+      if (n == 0) return;
+      integer lda = a.dist();
+      integer info;
+
+      // int dpotrf_(char *uplo, integer *n, doublereal *a, 
+      //             integer *lda, integer *info);
+
+      dpotrf_(&uplo_, &n, a.data(), &lda, &info);
+      if (info > 0)
+        throw std::runtime_error("LapackCholesky: matrix not positive definite, leading minor "
+                                 + std::to_string(info));
+    }
+
+    // b overwritten with A^{-1} b
+    template <typename TDIST>
+    void solve (VectorView<double,TDIST> b) const {
+      CallWithColMajorRHS (b, [this](double * pb, integer nrhs, integer ldb)
+                           { solveColMajor (pb, nrhs, ldb); });
+    }
+
+    // all columns of b overwritten with A^{-1} b
+    template <ORDERING OB>
+    void solve (MatrixView<double,OB> b) const {
+      CallWithColMajorRHS (b, [this](double * pb, integer nrhs, integer ldb)
+                           { solveColMajor (pb, nrhs, ldb); });
+    }
+
+  private:
+    void solveColMajor (double * pb, integer nrhs, integer ldb) const {
+      char uplo_ = uplo;
+      integer n = a.rows();
+      if (n == 0) return;
+      integer lda = a.dist();
+      integer info;
+
+      // int dpotrs_(char *uplo, integer *n, integer *nrhs, 
+      //             doublereal *a, integer *lda, doublereal *b, 
+      //             integer *ldb, integer *info);
+
+      dpotrs_(&uplo_, &n, &nrhs, a.data(), &lda, pb, &ldb, &info);
+    }
+  };
+
+
+
+  // Bunch-Kaufman factorization A = L D L^T of a symmetric, possibly
+  // indefinite matrix. Only the lower triangle of A is referenced.
+  template <ORDERING ORD>
+  class LapackLDLT {
+    Matrix <double, ORD> a;
+    std::vector<integer> ipiv;
+    static constexpr char uplo = (ORD == ColMajor) ? 'L' : 'U';
+    
+  public:
+    LapackLDLT (Matrix<double,ORD> _a)
+      : a(std::move(_a)), ipiv(a.rows()) {
+      char uplo_ = uplo;
+      integer n = a.rows();
+      if (n == 0) return;
+      integer lda = a.dist();
+      integer info;
+
+      // int dsytrf_(char *uplo, integer *n, doublereal *a, integer *lda, 
+      //             integer *ipiv, doublereal *work, integer *lwork, integer *info);
+
+      // query work-size
+      double hwork;
+      integer lwork = -1;
+      dsytrf_(&uplo_, &n, a.data(), &lda, ipiv.data(), &hwork, &lwork, &info);
+      lwork = integer(hwork);
+      std::vector<double> work(lwork);
+      dsytrf_(&uplo_, &n, a.data(), &lda, ipiv.data(), work.data(), &lwork, &info);
+      if (info > 0)
+        throw std::runtime_error("LapackLDLT: matrix singular, D("
+                                 + std::to_string(info) + ") = 0");
+    }
+
+    // b overwritten with A^{-1} b
+    template <typename TDIST>
+    void solve (VectorView<double,TDIST> b) const {
+      CallWithColMajorRHS (b, [this](double * pb, integer nrhs, integer ldb)
+                           { solveColMajor (pb, nrhs, ldb); });
+    }
+
+    // all columns of b overwritten with A^{-1} b
+    template <ORDERING OB>
+    void solve (MatrixView<double,OB> b) const {
+      CallWithColMajorRHS (b, [this](double * pb, integer nrhs, integer ldb)
+                           { solveColMajor (pb, nrhs, ldb); });
+    }
+
+  private:
+    void solveColMajor (double * pb, integer nrhs, integer ldb) const {
+      char uplo_ = uplo;
+      integer n = a.rows();
+      if (n == 0) return;
+      integer lda = a.dist();
+      integer info;
+
+      // int dsytrs_(char *uplo, integer *n, integer *nrhs, 
+      //             doublereal *a, integer *lda, integer *ipiv, 
+      //             doublereal *b, integer *ldb, integer *info);
+
+      dsytrs_(&uplo_, &n, &nrhs, a.data(), &lda, (integer*)ipiv.data(), pb, &ldb, &info);
+    }
+  };
+
+
+
+  // Householder QR factorization A = Q R of an m x n matrix.
+  // The reflectors are kept in LAPACK's compact form (ColMajor).
+  class LapackQR {
+    Matrix <double, ColMajor> a;
+    std::vector<double> tau;
+
+    // b overwritten with Q b (trans = 'N') or Q^T b (trans = 'T')
+    void multQ (char trans, double * pb, integer nrhs, integer ldb) const {
+      char side = 'L';
+      integer m = a.rows();
+      integer k = tau.size();
+      if (m == 0 || k == 0) return;
+      integer lda = a.dist();
+      integer info;
+
+      // int dormqr_(char *side, char *trans, integer *m, integer *n,
+      //             integer *k, doublereal *a, integer *lda, doublereal *tau,
+      //             doublereal *c, integer *ldc, doublereal *work, integer *lwork,
+      //             integer *info);
+
+      // query work-size
+      double hwork;
+      integer lwork = -1;
+      dormqr_(&side, &trans, &m, &nrhs, &k, a.data(), &lda, (double*)tau.data(),
+              pb, &ldb, &hwork, &lwork, &info);
+      lwork = integer(hwork);
+      std::vector<double> work(lwork);
+      dormqr_(&side, &trans, &m, &nrhs, &k, a.data(), &lda, (double*)tau.data(),
+              pb, &ldb, work.data(), &lwork, &info);
+    }
+
+    // b(0:n,:) overwritten with R^{-1} b(0:n,:)
+    void solveR (double * pb, integer nrhs, integer ldb) const {
+      char uplo = 'U', trans = 'N', diag = 'N';
+      integer n = a.cols();
+      if (n == 0) return;
+      integer lda = a.dist();
+      integer info;
+
+      // int dtrtrs_(char *uplo, char *trans, char *diag, integer *n,
+      //             integer *nrhs, doublereal *a, integer *lda,
+      //             doublereal *b, integer *ldb, integer *info);
+
+      dtrtrs_(&uplo, &trans, &diag, &n, &nrhs, a.data(), &lda, pb, &ldb, &info);
+      if (info > 0)
+        throw std::runtime_error("LapackQR: matrix rank deficient, R("
+                                 + std::to_string(info) + "," + std::to_string(info) + ") = 0");
+    }
+
+  public:
+    template <ORDERING ORD>
+    LapackQR (MatrixView<double,ORD> _a)
+      : a(_a.rows(), _a.cols()), tau(std::min(_a.rows(), _a.cols())) {
+      a = _a;
+      integer m = a.rows();
+      integer n = a.cols();
+      if (m == 0 || n == 0) return;
+      integer lda = a.dist();
+      integer info;
+
+      // int dgeqrf_(integer *m, integer *n, doublereal *a, integer *lda,
+      //             doublereal *tau, doublereal *work, integer *lwork, integer *info);
+
+      // query work-size
+      double hwork;
+      integer lwork = -1;
+      dgeqrf_(&m, &n, a.data(), &lda, tau.data(), &hwork, &lwork, &info);
+      lwork = integer(hwork);
+      std::vector<double> work(lwork);
+      dgeqrf_(&m, &n, a.data(), &lda, tau.data(), work.data(), &lwork, &info);
+    }
+
+    size_t rows() const { return a.rows(); }
+    size_t cols() const { return a.cols(); }
+
+    // b overwritten with Q^T b, b is a vector or a matrix with rows() rows
+    template <typename TB>
+    void applyQT (TB && b) const {
+      CallWithColMajorRHS (b, [this](double * pb, integer nrhs, integer ldb)
+                           { multQ ('T', pb, nrhs, ldb); });
+    }
+
+    // b overwritten with Q b
+    template <typename TB>
+    void applyQ (TB && b) const {
+      CallWithColMajorRHS (b, [this](double * pb, integer nrhs, integer ldb)
+                           { multQ ('N', pb, nrhs, ldb); });
+    }
+
+    // least squares solution of min |A x - b|, requires rows >= cols
+    template <typename TDIST>
+    Vector<double> solve (VectorView<double,TDIST> b) const {
+      if (a.rows() < a.cols())
+        throw std::invalid_argument("LapackQR::solve needs rows >= cols");
+      Vector<double> tmp(b.size());
+      tmp = b;
+      integer ldb = std::max<integer>(tmp.size(), 1);
+      multQ ('T', tmp.data(), 1, ldb);
+      solveR (tmp.data(), 1, ldb);
+      return Vector<double> (tmp.range(0, a.cols()));
+    }
+
+    // least squares solutions for all columns of b
+    template <ORDERING OB>
+    Matrix<double,ColMajor> solve (MatrixView<double,OB> b) const {
+      if (a.rows() < a.cols())
+        throw std::invalid_argument("LapackQR::solve needs rows >= cols");
+      Matrix<double,ColMajor> tmp(b.rows(), b.cols());
+      tmp = b;
+      integer ldb = std::max<integer>(tmp.dist(), 1);
+      multQ ('T', tmp.data(), tmp.cols(), ldb);
+      solveR (tmp.data(), tmp.cols(), ldb);
+      Matrix<double,ColMajor> x(a.cols(), b.cols());
+      x = tmp.rows(0, a.cols());
+      return x;
+    }
+
+    // economy size Q:  rows x min(rows,cols), orthonormal columns
+    Matrix<double,ColMajor> Q() const {
+      integer m = a.rows();
+      integer k = tau.size();
+      Matrix<double,ColMajor> q(m, k);
+      q = a.cols(0, k);
+      if (k == 0) return q;
+      integer lda = q.dist();
+      integer info;
+
+      // int dorgqr_(integer *m, integer *n, integer *k, doublereal *a,
+      //             integer *lda, doublereal *tau, doublereal *work,
+      //             integer *lwork, integer *info);
+
+      // query work-size
+      double hwork;
+      integer lwork = -1;
+      dorgqr_(&m, &k, &k, q.data(), &lda, (double*)tau.data(), &hwork, &lwork, &info);
+      lwork = integer(hwork);
+      std::vector<double> work(lwork);
+      dorgqr_(&m, &k, &k, q.data(), &lda, (double*)tau.data(), work.data(), &lwork, &info);
+      return q;
+    }
+
+    // upper triangular factor: min(rows,cols) x cols
+    Matrix<double,ColMajor> R() const {
+      Matrix<double,ColMajor> r(tau.size(), a.cols());
+      for (size_t j = 0; j < r.cols(); j++)
+        for (size_t i = 0; i < r.rows(); i++)
+          r(i,j) = (j >= i) ? a(i,j) : 0.0;
+      return r;
+    }
+  };
+
+
+
+  // Eigen-decomposition A = Z diag(w) Z^T of symmetric matrices.
+  // Only the lower triangle of A is referenced.
+  // The work arrays are sized by one lwork query and reused as long
+  // as the matrix size does not change, so the object should be kept
+  // alive over a sequence of equally sized problems.
+  class LapackSymEigen {
+    integer n = -1;
+    std::vector<double> amem;     // copy of A, overwritten by dsyevd_
+    std::vector<double> zmem;     // eigenvectors of dsyevr_
+    std::vector<double> w;
+    std::vector<integer> isuppz;
+    std::vector<double> work;
+    std::vector<integer> iwork;
+    integer num = 0;              // number of computed eigenpairs
+    bool vectors_in_a = false;
+
+    void setSize (integer _n) {
+      if (_n == n) return;
+      n = _n;
+      amem.resize(size_t(n)*n);
+      zmem.resize(size_t(n)*n);
+      w.resize(n);
+      isuppz.resize(2*std::max<integer>(n,1));
+
+      // query work-sizes of both drivers, keep the maximum
+      char jobz = 'V', uplo = 'L', range = 'A';
+      integer lda = std::max<integer>(n, 1);
+      integer lwork = -1, liwork = -1, info;
+      double hwork1, hwork2;
+      integer hiwork1, hiwork2;
+      dsyevd_(&jobz, &uplo, &n, amem.data(), &lda, w.data(),
+              &hwork1, &lwork, &hiwork1, &liwork, &info);
+
+      double vl = 0, vu = 0, abstol = 0;
+      integer il = 1, iu = n, m;
+      dsyevr_(&jobz, &range, &uplo, &n, amem.data(), &lda, &vl, &vu, &il, &iu,
+              &abstol, &m, w.data(), zmem.data(), &lda, isuppz.data(),
+              &hwork2, &lwork, &hiwork2, &liwork, &info);
+
+      work.resize(std::max(integer(hwork1), integer(hwork2)));
+      iwork.resize(std::max(hiwork1, hiwork2));
+    }
+
+    template <ORDERING ORD>
+    void copyMatrix (MatrixView<double,ORD> A) {
+      if (A.rows() != A.cols())
+        throw std::invalid_argument("LapackSymEigen: matrix must be square");
+      setSize (A.rows());
+      MatrixView<double,ColMajor> (n, n, amem.data()) = A;
+    }
+
+    void callSyevr (bool vectors, char range, double vl, double vu, integer il, integer iu) {
+      char jobz = vectors ? 'V' : 'N';
+      char uplo = 'L';
+      integer lda = std::max<integer>(n, 1);
+      integer lwork = work.size();
+      integer liwork = iwork.size();
+      double abstol = 0;
+      integer info;
+
+      // int dsyevr_(char *jobz, char *range, char *uplo, integer *n,
+      //             doublereal *a, integer *lda, doublereal *vl, doublereal *vu,
+      //             integer *il, integer *iu, doublereal *abstol, integer *m,
+      //             doublereal *w, doublereal *z, integer *ldz, integer *isuppz,
+      //             doublereal *work, integer *lwork, integer *iwork,
+      //             integer *liwork, integer *info);
+
+      dsyevr_(&jobz, &range, &uplo, &n, amem.data(), &lda, &vl, &vu, &il, &iu,
+              &abstol, &num, w.data(), zmem.data(), &lda, isuppz.data(),
+              work.data(), &lwork, iwork.data(), &liwork, &info);
+      vectors_in_a = false;
+      if (info != 0)
+        throw std::runtime_error("LapackSymEigen: dsyevr failed, info = " + std::to_string(info));
+    }
+
+  public:
+    LapackSymEigen () = default;
+    LapackSymEigen (size_t _n) { setSize(_n); }
+
+    // all eigenvalues (ascending) and optionally eigenvectors, by divide and conquer
+    template <ORDERING ORD>
+    void compute (MatrixView<double,ORD> A, bool vectors = true) {
+      copyMatrix (A);
+      char jobz = vectors ? 'V' : 'N';
+      char uplo = 'L';
+      integer lda = std::max<integer>(n, 1);
+      integer lwork = work.size();
+      integer liwork = iwork.size();
+      integer info;
+
+      // int dsyevd_(char *jobz, char *uplo, integer *n, doublereal *a,
+      //             integer *lda, doublereal *w, doublereal *work, integer *lwork,
+      //             integer *iwork, integer *liwork, integer *info);
+
+      dsyevd_(&jobz, &uplo, &n, amem.data(), &lda, w.data(),
+              work.data(), &lwork, iwork.data(), &liwork, &info);
+      num = n;
+      vectors_in_a = true;
+      if (info != 0)
+        throw std::runtime_error("LapackSymEigen: dsyevd failed, info = " + std::to_string(info));
+    }
+
+    // eigenpairs with (ascending) index in [first, next)
+    template <ORDERING ORD>
+    void computeByIndex (MatrixView<double,ORD> A, size_t first, size_t next,
+                         bool vectors = true) {
+      copyMatrix (A);
+      if (first >= next || next > size_t(n))
+        throw std::invalid_argument("LapackSymEigen: invalid index range");
+      callSyevr (vectors, 'I', 0, 0, first+1, next);
+    }
+
+    // eigenpairs with eigenvalue in the interval (lower, upper]
+    template <ORDERING ORD>
+    void computeByValue (MatrixView<double,ORD> A, double lower, double upper,
+                         bool vectors = true) {
+      copyMatrix (A);
+      if (!(lower < upper))
+        throw std::invalid_argument("LapackSymEigen: invalid value range");
+      callSyevr (vectors, 'V', lower, upper, 1, std::max<integer>(n,1));
+    }
+
+    size_t size() const { return std::max<integer>(n, 0); }
+    size_t numEigenvalues() const { return num; }
+
+    // computed eigenvalues, ascending
+    VectorView<double> eigenvalues() const {
+      return VectorView<double> (num, (double*)w.data());
+    }
+
+    // computed eigenvectors as columns, valid if computed with vectors = true
+    MatrixView<double,ColMajor> eigenvectors() const {
+      const double * z = vectors_in_a ? amem.data() : zmem.data();
+      return MatrixView<double,ColMajor> (n, num, std::max<integer>(n,1), (double*)z);
+    }
+  };
+
+
+
+  // Singular value decomposition A = U diag(S) V^T by divide and conquer.
+  // thin: U is m x k, V^T is k x n with k = min(m,n),
+  // full: U is m x m, V^T is n x n.
+  class LapackSVD {
+    Matrix <double, ColMajor> u;
+    Vector <double> s;
+    Matrix <double, ColMajor> vt;
+
+  public:
+    template <ORDERING ORD>
+    LapackSVD (MatrixView<double,ORD> A, bool full = false, bool vectors = true)
+      : u(A.rows(), !vectors ? 0 : full ? A.rows() : std::min(A.rows(), A.cols())),
+        s(std::min(A.rows(), A.cols())),
+        vt(!vectors ? 0 : full ? A.cols() : std::min(A.rows(), A.cols()), A.cols())
+    {
+      Matrix<double,ColMajor> a(A.rows(), A.cols());
+      a = A;
+      char jobz = !vectors ? 'N' : full ? 'A' : 'S';
+      integer m = a.rows();
+      integer n = a.cols();
+      if (m == 0 || n == 0) return;
+      integer lda = a.dist();
+      integer ldu = std::max<integer>(m, 1);
+      integer ldvt = std::max<integer>(vt.rows(), 1);
+      std::vector<integer> iwork(8*std::min(m,n));
+      integer info;
+
+      // int dgesdd_(char *jobz, integer *m, integer *n, doublereal *a,
+      //             integer *lda, doublereal *s, doublereal *u, integer *ldu,
+      //             doublereal *vt, integer *ldvt, doublereal *work,
+      //             integer *lwork, integer *iwork, integer *info);
+
+      // query work-size
+      double hwork;
+      integer lwork = -1;
+      dgesdd_(&jobz, &m, &n, a.data(), &lda, s.data(), u.data(), &ldu,
+              vt.data(), &ldvt, &hwork, &lwork, iwork.data(), &info);
+      lwork = integer(hwork);
+      std::vector<double> work(lwork);
+      dgesdd_(&jobz, &m, &n, a.data(), &lda, s.data(), u.data(), &ldu,
+              vt.data(), &ldvt, work.data(), &lwork, iwork.data(), &info);
+      if (info > 0)
+        throw std::runtime_error("LapackSVD: dgesdd did not converge");
+    }
+
+    // singular values, descending
+    VectorView<double> S() const { return s; }
+    MatrixView<double,ColMajor> U() const { return u; }
+    MatrixView<double,ColMajor> Vt() const { return vt; }
+  };
+
+
+
+  // LU factorization with partial pivoting of a band matrix, O(n kl (kl+ku))
+  class LapackBandLU {
+    BandMatrix<double> a;
+    std::vector<integer> ipiv;
+
+    void solveColMajor (double * pb, integer nrhs, integer ldb) const {
+      char transa = 'N';
+      integer n = a.rows();
+      if (n == 0) return;
+      integer kl = a.kl();
+      integer ku = a.ku();
+      integer ldab = a.dist();
+      integer info;
+
+      // int dgbtrs_(char *trans, integer *n, integer *kl, integer *ku,
+      //             integer *nrhs, doublereal *ab, integer *ldab, integer *ipiv,
+      //             doublereal *b, integer *ldb, integer *info);
+
+      dgbtrs_(&transa, &n, &kl, &ku, &nrhs, (double*)a.data(), &ldab,
+              (integer*)ipiv.data(), pb, &ldb, &info);
+    }
+
+  public:
+    LapackBandLU (BandMatrix<double> _a)
+      : a(std::move(_a)), ipiv(a.rows()) {
+      integer n = a.rows();
+      if (n == 0) return;
+      integer kl = a.kl();
+      integer ku = a.ku();
+      integer ldab = a.dist();
+      integer info;
+
+      // int dgbtrf_(integer *m, integer *n, integer *kl, integer *ku,
+      //             doublereal *ab, integer *ldab, integer *ipiv, integer *info);
+
+      dgbtrf_(&n, &n, &kl, &ku, a.data(), &ldab, ipiv.data(), &info);
+      if (info > 0)
+        throw std::runtime_error("LapackBandLU: matrix singular, U("
+                                 + std::to_string(info) + "," + std::to_string(info) + ") = 0");
+    }
+
+    // b overwritten with A^{-1} b
+    template <typename TDIST>
+    void solve (VectorView<double,TDIST> b) const {
+      CallWithColMajorRHS (b, [this](double * pb, integer nrhs, integer ldb)
+                           { solveColMajor (pb, nrhs, ldb); });
+    }
+
+    // all columns of b overwritten with A^{-1} b
+    template <ORDERING OB>
+    void solve (MatrixView<double,OB> b) const {
+      CallWithColMajorRHS (b, [this](double * pb, integer nrhs, integer ldb)
+                           { solveColMajor (pb, nrhs, ldb); });
+    }
   };
   
 }
@@ -0,0 +1,166 @@
+#ifndef FILE_LOWRANK_UPDATE_HPP
+#define FILE_LOWRANK_UPDATE_HPP
+
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include "lapack_interface.hpp"
+
+
+namespace nanoblas
+{
+
+  /*
+    LU solver for a matrix which is modified by low-rank terms,
+
+      A = A0 + U V^T,    U, V: n x k,
+
+    using the Sherman-Morrison-Woodbury formula with the factorization
+    of A0:
+
+      A^{-1} b = y - Z C^{-1} V^T y,   y = A0^{-1} b,  Z = A0^{-1} U,
+      C = I + V^T Z  (k x k capacitance matrix)
+
+    An update of rank r costs O(n^2 r) (r solves with A0 and the dense
+    update of the stored matrix), a solve costs O(n^2 + n k).
+
+    Heuristic: every solve pays 4nk extra, and the updates so far cost
+    about 2n^2 k. Once k exceeds refactorRank (default n/16, i.e. 12.5%
+    overhead per solve and 2n^2k ~ n^3/8 setup compared to the 2/3 n^3
+    of a new LU), the current A is factored from scratch and the
+    low-rank terms are dropped.
+  */
+
+  template <ORDERING ORD = ColMajor>
+  class WoodburyLU
+  {
+    Matrix<double,ORD> a;                   // current matrix A0 + U V^T
+    std::unique_ptr<LapackLU<ORD>> lu;      // factorization of A0
+    std::vector<double> umem, vmem, zmem;   // n x k, ColMajor
+    size_t k = 0;
+    size_t refactor_rank;
+    std::unique_ptr<LapackLU<ColMajor>> clu;
+
+    size_t n() const { return a.rows(); }
+    MatrixView<double,ColMajor> U() const { return { n(), k, (double*)umem.data() }; }
+    MatrixView<double,ColMajor> V() const { return { n(), k, (double*)vmem.data() }; }
+    MatrixView<double,ColMajor> Z() const { return { n(), k, (double*)zmem.data() }; }
+
+    void refactor ()
+    {
+      lu = std::make_unique<LapackLU<ORD>>(a);
+      umem.clear(); vmem.clear(); zmem.clear();
+      k = 0;
+      clu.reset();
+    }
+
+  public:
+    WoodburyLU (Matrix<double,ORD> _a)
+      : a(std::move(_a)), refactor_rank(std::max<size_t>(1, a.rows()/16))
+    {
+      if (a.rows() != a.cols())
+        throw std::invalid_argument("WoodburyLU: matrix must be square");
+      refactor();
+    }
+
+    size_t rank() const { return k; }
+    size_t refactorRank() const { return refactor_rank; }
+    void setRefactorRank (size_t r) { refactor_rank = r; }
+    MatrixView<double,ORD> matrix() const { return a; }
+
+
+    // A += U V^T,  U and V are n x r
+    template <ORDERING OU, ORDERING OV>
+    void update (MatrixView<double,OU> Unew, MatrixView<double,OV> Vnew)
+    {
+      const size_t r = Unew.cols();
+      if (Unew.rows() != n() || Vnew.rows() != n() || Vnew.cols() != r)
+        throw std::invalid_argument("WoodburyLU::update: U and V must be n x r");
+      if (r == 0) return;
+
+      // dense matrix: a += Unew Vnew^T, accumulated by dgemm with beta = 1
+      MultMatMatLapack (Unew, trans(Vnew), MatrixView<double,ORD>(a), 1.0);
+
+      if (k + r > refactor_rank)
+        {
+          refactor();
+          return;
+        }
+
+      umem.resize(n()*(k+r));
+      vmem.resize(n()*(k+r));
+      zmem.resize(n()*(k+r));
+      MatrixView<double,ColMajor> Uadd(n(), r, umem.data()+n()*k);
+      MatrixView<double,ColMajor> Vadd(n(), r, vmem.data()+n()*k);
+      MatrixView<double,ColMajor> Zadd(n(), r, zmem.data()+n()*k);
+      Uadd = Unew;
+      Vadd = Vnew;
+      lu->solve (Unew, Zadd);      // Z = A0^{-1} U
+      k += r;
+
+      // C = I + V^T Z
+      Matrix<double,ColMajor> C(k, k);
+      MultMatMatLapack (trans(V()), Z(), MatrixView<double,ColMajor>(C));
+      for (size_t i = 0; i < k; i++)
+        C(i,i) += 1;
+      clu = std::make_unique<LapackLU<ColMajor>>(C);
+    }
+
+    // A(i,:) = row
+    template <typename TDIST>
+    void updateRow (size_t i, VectorView<double,TDIST> row)
+    {
+      Matrix<double,ColMajor> u(n(), 1), v(n(), 1);
+      u = 0.0;
+      u(i,0) = 1;
+      for (size_t j = 0; j < n(); j++)
+        v(j,0) = row(j) - a(i,j);
+      update (MatrixView<double,ColMajor>(u), MatrixView<double,ColMajor>(v));
+    }
+
+    // A(:,j) = col
+    template <typename TDIST>
+    void updateCol (size_t j, VectorView<double,TDIST> col)
+    {
+      Matrix<double,ColMajor> u(n(), 1), v(n(), 1);
+      v = 0.0;
+      v(j,0) = 1;
+      for (size_t i = 0; i < n(); i++)
+        u(i,0) = col(i) - a(i,j);
+      update (MatrixView<double,ColMajor>(u), MatrixView<double,ColMajor>(v));
+    }
+
+
+    // b overwritten with A^{-1} b
+    template <typename TDIST>
+    void solve (VectorView<double,TDIST> b) const
+    {
+      lu->solve (b);
+      if (k == 0) return;
+
+      Vector<double> t(k);
+      t = trans(V()) * b;
+      clu->solve (t);
+      b -= Z() * t;
+    }
+
+    // all columns of b overwritten with A^{-1} b
+    template <ORDERING OB>
+    void solve (MatrixView<double,OB> b) const
+    {
+      lu->solve (b);
+      if (k == 0) return;
+
+      Matrix<double,ColMajor> t(k, b.cols());
+      MultMatMatLapack (trans(V()), b, MatrixView<double,ColMajor>(t));
+      clu->solve (t);
+      Matrix<double,ColMajor> zt(n(), b.cols());
+      MultMatMatLapack (Z(), MatrixView<double,ColMajor>(t), MatrixView<double,ColMajor>(zt));
+      b -= zt;
+    }
+  };
+
+}
+
+#endif
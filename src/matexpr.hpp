@@ -4,6 +4,7 @@
 #include <cstddef>
 #include <iostream>
 #include <algorithm>
+#include <array>
 
 
 #include "vecexpr.hpp"
@@ -30,6 +31,15 @@ namespace nanoblas
     auto operator() (size_t i, size_t j) const { return derived()(i,j); }
   };
   
+  // type in which an operand is stored inside an expression:
+  // expressions by value, Matrix and Vector as views (see matrix.hpp)
+  template <typename T>
+  struct ExprStorage { using type = T; };
+
+  template <typename T>
+  using expr_storage_t = typename ExprStorage<T>::type;
+
+
   // ************************* output operator *******************
   
   template <typename TM>
@@ -54,7 +64,7 @@ namespace nanoblas
     TB b;
   public:
     SumMatExpr (TA _a, TB _b) : a(_a), b(_b) { }
-    auto operator() (size_t i) const { return a(i)+b(i); }
+    auto operator() (size_t i, size_t j) const { return a(i,j)+b(i,j); }
     size_t rows() const { return a.rows(); }
     size_t cols() const { return a.cols(); }  
     auto shape() const { return a.shape(); }    
@@ -64,7 +74,100 @@ namespace nanoblas
   auto operator+ (const MatExpr<TA>& a, const MatExpr<TB>& b)
   {
     assert(a.rows()==b.rows() && a.cols()==b.cols());
-    return SumMatExpr(a.derived(), b.derived());
+    return SumMatExpr<expr_storage_t<TA>,expr_storage_t<TB>>
+      (static_cast<const TA&>(a), static_cast<const TB&>(b));
+  }
+
+
+  // ************************* SubMatExpr *******************  
+
+  template <typename TA, typename TB>
+  class SubMatExpr : public MatExpr<SubMatExpr<TA,TB>>
+  {
+    TA a;
+    TB b;
+  public:
+    SubMatExpr (TA _a, TB _b) : a(_a), b(_b) { }
+    auto operator() (size_t i, size_t j) const { return a(i,j)-b(i,j); }
+    size_t rows() const { return a.rows(); }
+    size_t cols() const { return a.cols(); }  
+    auto shape() const { return a.shape(); }    
+  };
+  
+  template <typename TA, typename TB>
+  auto operator- (const MatExpr<TA>& a, const MatExpr<TB>& b)
+  {
+    assert(a.rows()==b.rows() && a.cols()==b.cols());
+    return SubMatExpr<expr_storage_t<TA>,expr_storage_t<TB>>
+      (static_cast<const TA&>(a), static_cast<const TB&>(b));
+  }
+
+
+  // ************************* NegMatExpr *******************  
+
+  template <typename TA>
+  class NegMatExpr : public MatExpr<NegMatExpr<TA>>
+  {
+    TA a;
+  public:
+    NegMatExpr (TA _a) : a(_a) { }
+    auto operator() (size_t i, size_t j) const { return -a(i,j); }
+    size_t rows() const { return a.rows(); }
+    size_t cols() const { return a.cols(); }  
+    auto shape() const { return a.shape(); }    
+  };
+  
+  template <typename TA>
+  auto operator- (const MatExpr<TA>& a)
+  {
+    return NegMatExpr<expr_storage_t<TA>>(static_cast<const TA&>(a));
+  }
+
+
+  // ************************* TransMatExpr *******************  
+
+  // transpose of an expression, trans(MatrixView) is a view (see matrix.hpp)
+  template <typename TA>
+  class TransMatExpr : public MatExpr<TransMatExpr<TA>>
+  {
+    TA a;
+  public:
+    TransMatExpr (TA _a) : a(_a) { }
+    auto operator() (size_t i, size_t j) const { return a(j,i); }
+    size_t rows() const { return a.cols(); }
+    size_t cols() const { return a.rows(); }  
+    auto shape() const { return std::array<size_t,2>{a.cols(), a.rows()}; }
+  };
+  
+  template <typename TA>
+  auto trans (const MatExpr<TA>& a)
+  {
+    return TransMatExpr<expr_storage_t<TA>>(static_cast<const TA&>(a));
+  }
+
+
+  // ************************* HadamardMatExpr *******************  
+
+  // elementwise product
+  template <typename TA, typename TB>
+  class HadamardMatExpr : public MatExpr<HadamardMatExpr<TA,TB>>
+  {
+    TA a;
+    TB b;
+  public:
+    HadamardMatExpr (TA _a, TB _b) : a(_a), b(_b) { }
+    auto operator() (size_t i, size_t j) const { return a(i,j)*b(i,j); }
+    size_t rows() const { return a.rows(); }
+    size_t cols() const { return a.cols(); }  
+    auto shape() const { return a.shape(); }    
+  };
+  
+  template <typename TA, typename TB>
+  auto hadamard (const MatExpr<TA>& a, const MatExpr<TB>& b)
+  {
+    assert(a.rows()==b.rows() && a.cols()==b.cols());
+    return HadamardMatExpr<expr_storage_t<TA>,expr_storage_t<TB>>
+      (static_cast<const TA&>(a), static_cast<const TB&>(b));
   }
 
 
@@ -81,6 +184,7 @@ namespace nanoblas
     auto operator() (size_t i, size_t j) const { return m_scal*m_mat(i,j); }
     size_t rows() const { return m_mat.rows(); }
     size_t cols() const { return m_mat.cols(); }  
+    auto shape() const { return m_mat.shape(); }    
   };
 
 
@@ -92,7 +196,7 @@ namespace nanoblas
   template <typename TSCAL, typename T> requires (isScalar<TSCAL>())
   auto operator* (TSCAL scal, const MatExpr<T>& m)
   {
-    return ScaleMatExpr(scal, m.derived());
+    return ScaleMatExpr<TSCAL,expr_storage_t<T>>(scal, static_cast<const T&>(m));
   }
   
   
@@ -106,6 +210,8 @@ namespace nanoblas
     TB b;
   public:
     MultMatMatExpr (TA _a, TB _b) : a(_a), b(_b) { }
+    const TA & left() const { return a; }
+    const TB & right() const { return b; }
     size_t rows() const { return a.rows(); }
     size_t cols() const { return b.cols(); }
     auto shape() const { return std::array<size_t,2>{a.shape()[0], b.shape()[1]}; }
@@ -129,7 +235,8 @@ namespace nanoblas
   auto operator* (const MatExpr<TA>& a, const MatExpr<TB>& b)
   {
     assert(a.cols()==b.rows());
-    return MultMatMatExpr<TA,TB>(a.derived(), b.derived());
+    return MultMatMatExpr<expr_storage_t<TA>,expr_storage_t<TB>>
+      (static_cast<const TA&>(a), static_cast<const TB&>(b));
   }
   
 
@@ -163,9 +270,49 @@ namespace nanoblas
   auto operator* (const MatExpr<TA>& a, const VecExpr<TB>& b)
   {
     assert(a.cols()==b.size());    
-    return MultMatVecExpr<TA,TB>(a.derived(), b.derived());
+    return MultMatVecExpr<expr_storage_t<TA>,expr_storage_t<TB>>
+      (static_cast<const TA&>(a), static_cast<const TB&>(b));
   }
- 
+
+
+  // ************************* OuterProductExpr *******************
+
+  // scal * x y^T, MatrixView += / -= evaluate it with the rank-1 kernel
+  template <typename TSCAL, typename TX, typename TY>
+  class OuterProductExpr : public MatExpr<OuterProductExpr<TSCAL,TX,TY>>
+  {
+    TSCAL m_scal;
+    TX x;
+    TY y;
+  public:
+    OuterProductExpr (TSCAL scal, TX _x, TY _y) : m_scal(scal), x(_x), y(_y) { }
+    TSCAL scale() const { return m_scal; }
+    const TX & left() const { return x; }
+    const TY & right() const { return y; }
+    auto operator() (size_t i, size_t j) const { return m_scal*x(i)*y(j); }
+    size_t rows() const { return x.size(); }
+    size_t cols() const { return y.size(); }
+    auto shape() const { return std::array<size_t,2>{x.size(), y.size()}; }
+  };
+
+  template <typename TX, typename TY>
+  auto outer (const VecExpr<TX>& x, const VecExpr<TY>& y)
+  {
+    using elemtypeX = std::invoke_result<TX,size_t>::type;
+    using elemtypeY = std::invoke_result<TY,size_t>::type;
+    using TSCAL = std::remove_cvref_t<decltype(std::declval<elemtypeX>()*std::declval<elemtypeY>())>;
+    return OuterProductExpr<TSCAL,expr_storage_t<TX>,expr_storage_t<TY>>
+      (TSCAL(1), static_cast<const TX&>(x), static_cast<const TY&>(y));
+  }
+
+  // the factor stays in the node, so alpha * outer(x,y) is still a rank-1 update
+  template <typename TSCAL, typename TS, typename TX, typename TY> requires (isScalar<TSCAL>())
+  auto operator* (TSCAL scal, const OuterProductExpr<TS,TX,TY>& m)
+  {
+    using TPROD = decltype(scal*m.scale());
+    return OuterProductExpr<TPROD,TX,TY>(scal*m.scale(), m.left(), m.right());
+  }
+
 
 
   
@@ -14,6 +14,32 @@ namespace ASC_HPC {
 namespace nanoblas
 {
   
+  template <typename T, ORDERING OA, ORDERING OC>
+  void SymmetricRankK (MatrixView<T,OA> A, MatrixView<T,OC> C, bool mirror = true);
+
+  template <typename T, ORDERING ORD, typename TX, typename TY>
+  void RankOneUpdate (T alpha, const VecExpr<TX> & x, const VecExpr<TY> & y, MatrixView<T,ORD> A);
+
+  template <typename T, ORDERING OX, ORDERING OY, ORDERING OA>
+  void RankKUpdate (T alpha, MatrixView<T,OX> X, MatrixView<T,OY> Y, MatrixView<T,OA> A);
+
+  template <typename T, ORDERING OA, ORDERING OB>
+  void Transpose (MatrixView<T,OA> A, MatrixView<T,OB> B);
+
+  template <typename T, ORDERING ORD>
+  constexpr ORDERING OrderingOf (const MatrixView<T,ORD> &) { return ORD; }
+
+  // b is trans(a): the same memory with the other ordering
+  template <typename TA, typename TB>
+  bool IsTransposedView (const TA & a, const TB & b)
+  {
+    if constexpr (requires { a.data(); a.dist(); OrderingOf(a); b.data(); b.dist(); OrderingOf(b); })
+      return OrderingOf(a) != OrderingOf(b) && a.data() == b.data() && a.dist() == b.dist()
+        && a.rows() == b.cols() && a.cols() == b.rows();
+    else
+      return false;
+  }
+
 
   template <typename T, ORDERING ORD>
   class MatrixView : public MatExpr<MatrixView<T,ORD>>
@@ -27,6 +53,33 @@ namespace nanoblas
     {
       return (ORD==RowMajor) ? i*m_dist+j : j*m_dist+i;
     }
+
+    /*
+      Calls f(i,j) for all entries, tile by tile. The contiguous index
+      of the view runs innermost, the tiles keep the rows/columns of
+      a source with the other ordering (e.g. a transpose) in cache.
+    */
+    template <typename FUNC>
+    void forEachTiled (FUNC f) const
+    {
+      constexpr size_t TILE = 64;
+      constexpr bool rowmajor = (ORD == RowMajor);
+      const size_t nouter = rowmajor ? m_rows : m_cols;
+      const size_t ninner = rowmajor ? m_cols : m_rows;
+
+      for (size_t o1 = 0; o1 < nouter; o1 += TILE)
+        for (size_t i1 = 0; i1 < ninner; i1 += TILE)
+          {
+            const size_t o2 = std::min(nouter, o1+TILE);
+            const size_t i2 = std::min(ninner, i1+TILE);
+            for (size_t o = o1; o < o2; o++)
+              for (size_t i = i1; i < i2; i++)
+                if constexpr (rowmajor)
+                  f(o,i);
+                else
+                  f(i,o);
+          }
+    }
   public:
     MatrixView() = default;
     MatrixView(const MatrixView &) = default;
@@ -47,26 +100,42 @@ namespace nanoblas
 
     MatrixView& operator= (const MatrixView& m2)
     {
-      for (size_t i = 0; i < m_rows; i++)
-        for (size_t j = 0; j < m_cols; j++)
-          (*this)(i,j) = m2(i,j);
+      forEachTiled ([&](size_t i, size_t j) { (*this)(i,j) = m2(i,j); });
       return *this;
     }
     
+    // RowMajor <-> ColMajor conversion by the transpose kernel (transpose.hpp)
+    template <ORDERING ORD2> requires (ORD2 != ORD)
+    MatrixView& operator= (const MatrixView<T,ORD2>& m2)
+    {
+      Transpose (trans(m2), *this);
+      return *this;
+    }
+
     template <typename TB>
     MatrixView& operator= (const MatExpr<TB>& m2)
     {
-      for (size_t i = 0; i < m_rows; i++)
-        for (size_t j = 0; j < m_cols; j++)
-          (*this)(i,j) = m2(i,j);
+      forEachTiled ([&](size_t i, size_t j) { (*this)(i,j) = m2(i,j); });
       return *this;
     }
         
+    // C = A^T A and C = A A^T use the symmetric rank-k kernel
+    template <typename TA, typename TB>
+    MatrixView& operator= (const MultMatMatExpr<TA,TB>& m2)
+    {
+      if constexpr (requires { SymmetricRankK (m2.left(), *this, true); })
+        if (IsTransposedView(m2.left(), m2.right()))
+          {
+            SymmetricRankK (m2.left(), *this, true);
+            return *this;
+          }
+      forEachTiled ([&](size_t i, size_t j) { (*this)(i,j) = m2(i,j); });
+      return *this;
+    }
+
     MatrixView& operator= (T scal)
     {
-      for (size_t i = 0; i < m_rows; i++)
-        for (size_t j = 0; j < m_cols; j++)
-          (*this)(i,j) = scal;
+      forEachTiled ([&](size_t i, size_t j) { (*this)(i,j) = scal; });
       return *this;
     }
         
@@ -90,26 +159,55 @@ namespace nanoblas
     template <typename TB>
     MatrixView& operator+= (const MatExpr<TB>& m2)
     {
-      for (size_t i = 0; i < m_rows; i++)
-        for (size_t j = 0; j < m_cols; j++)
-          (*this)(i,j) += m2(i,j);
+      forEachTiled ([&](size_t i, size_t j) { (*this)(i,j) += m2(i,j); });
       return *this;
     }
     
     template <typename TB>
     MatrixView& operator-= (const MatExpr<TB>& m2)
     {
-      for (size_t i = 0; i < m_rows; i++)
-        for (size_t j = 0; j < m_cols; j++)
-          (*this)(i,j) -= m2(i,j);
+      forEachTiled ([&](size_t i, size_t j) { (*this)(i,j) -= m2(i,j); });
+      return *this;
+    }
+
+    // A += alpha x y^T and A += X Y^T use the rank-1 / rank-k kernels
+    template <typename TS, typename TX, typename TY>
+    MatrixView& operator+= (const OuterProductExpr<TS,TX,TY>& m2)
+    {
+      RankOneUpdate (T(m2.scale()), m2.left(), m2.right(), *this);
+      return *this;
+    }
+
+    template <typename TS, typename TX, typename TY>
+    MatrixView& operator-= (const OuterProductExpr<TS,TX,TY>& m2)
+    {
+      RankOneUpdate (T(-m2.scale()), m2.left(), m2.right(), *this);
+      return *this;
+    }
+
+    template <typename TA, typename TB>
+    MatrixView& operator+= (const MultMatMatExpr<TA,TB>& m2)
+    {
+      if constexpr (requires { RankKUpdate (T(1), m2.left(), trans(m2.right()), *this); })
+        RankKUpdate (T(1), m2.left(), trans(m2.right()), *this);
+      else
+        forEachTiled ([&](size_t i, size_t j) { (*this)(i,j) += m2(i,j); });
+      return *this;
+    }
+
+    template <typename TA, typename TB>
+    MatrixView& operator-= (const MultMatMatExpr<TA,TB>& m2)
+    {
+      if constexpr (requires { RankKUpdate (T(-1), m2.left(), trans(m2.right()), *this); })
+        RankKUpdate (T(-1), m2.left(), trans(m2.right()), *this);
+      else
+        forEachTiled ([&](size_t i, size_t j) { (*this)(i,j) -= m2(i,j); });
       return *this;
     }
 
     MatrixView& operator*= (T scal)
     {
-      for (size_t i = 0; i < rows(); i++)
-        for (size_t j = 0; j < cols(); j++)
-          (*this)(i,j) *= scal;
+      forEachTiled ([&](size_t i, size_t j) { (*this)(i,j) *= scal; });
       return *this;
     }
 
@@ -205,6 +303,13 @@ namespace nanoblas
                     
   };
 
+  // a Matrix operand is referenced, not copied, by expressions
+  template <typename T, ORDERING ORD>
+  struct ExprStorage<Matrix<T,ORD>> { using type = MatrixView<T,ORD>; };
+
+  template <typename T>
+  struct ExprStorage<Vector<T>> { using type = VectorView<T>; };
+
 // Annahme: MatrixView-Schnittstelle wie im Skript:
 // - size_t rows() const;
 // - size_t cols() const;
@@ -361,7 +466,197 @@ void addMatMat2 (MatrixView<T,ORD> A,
     });
   }
 
+
+
+  /*
+    Symmetric rank-k update  C = A A^T,  A: n x k,  C: n x n.
+    Only the lower triangle of C is written, with mirror the upper
+    triangle is copied from it. C = A^T A is SymmetricRankK(trans(A), C).
+
+    The lower block triangle of C is split into NB x NB blocks, so
+    about half the flops of the general product are spent. With few
+    blocks (a Gram matrix of a tall A) the k dimension is split into
+    chunks as well, every task sums a partial block, the partial
+    blocks are added up at the end. A task copies only KB wide
+    panels of its rows of A for addMatMat, the other operand is a
+    view into A. Diagonal blocks are computed in full, only their
+    lower part is stored.
+  */
+  template <typename T, ORDERING OA, ORDERING OC>
+  void SymmetricRankK (MatrixView<T,OA> A, MatrixView<T,OC> C, bool mirror)
+  {
+    constexpr size_t NB = 96;        // block size of C
+    constexpr size_t KB = 256;       // panel width
+    constexpr size_t KMIN = 4096;    // min. length of a k-chunk
+    const size_t n = A.rows();
+    const size_t k = A.cols();
+    assert(C.rows() == n && C.cols() == n);
+    if (n == 0) return;
+
+    const size_t nb = (n + NB - 1) / NB;
+    const size_t num_blocks = nb*(nb+1)/2;
+    const size_t num_chunks = std::clamp<size_t>(std::min(64 / num_blocks, k / KMIN), 1, 64);
+    const size_t num_tasks = num_blocks * num_chunks;
+    std::vector<T> partial((num_chunks > 1) ? num_tasks*NB*NB : 0);
+
+    auto blockRange = [&](size_t blk)
+    {
+      // block (bi, bj), bj <= bi
+      size_t bi = 0;
+      while ((bi+1)*(bi+2)/2 <= blk) bi++;
+      const size_t bj = blk - bi*(bi+1)/2;
+      return std::array<size_t,4> { bi*NB, std::min(n, bi*NB+NB), bj*NB, std::min(n, bj*NB+NB) };
+    };
+
+    // lower part of block (i1..i2, j1..j2) of C from cb(i,j)
+    auto store = [&](std::array<size_t,4> r, auto && cb)
+    {
+      auto [i1, i2, j1, j2] = r;
+      for (size_t j = j1; j < j2; j++)
+        for (size_t i = std::max(i1, (i1 == j1) ? j : i1); i < i2; i++)
+          C(i,j) = cb(i-i1, j-j1);
+    };
+
+    ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+    {
+      const size_t blk = t / num_chunks, chunk = t % num_chunks;
+      const auto range = blockRange(blk);
+      auto [i1, i2, j1, j2] = range;
+      const size_t k1 = chunk*k/num_chunks, k2 = (chunk+1)*k/num_chunks;
+
+      Matrix<T,ColMajor> Cb(i2-i1, j2-j1);
+      Cb = T(0);
+      // panel of the operand that is not ColMajor in A
+      Matrix<T,ColMajor> panel((OA == ColMajor) ? KB : NB, (OA == ColMajor) ? NB : KB);
+
+      for (size_t c1 = k1; c1 < k2; c1 += KB)
+        {
+          const size_t c2 = std::min(k2, c1+KB);
+          auto Ai = A.rows(i1, i2).cols(c1, c2);
+          auto Aj = A.rows(j1, j2).cols(c1, c2);
+          if constexpr (OA == ColMajor)
+            {
+              auto Bt = MatrixView<T,ColMajor>(panel).rows(0, c2-c1).cols(0, j2-j1);
+              Bt = trans(Aj);
+              addMatMat (Ai, Bt, MatrixView<T,ColMajor>(Cb));
+            }
+          else
+            {
+              auto Ap = MatrixView<T,ColMajor>(panel).rows(0, i2-i1).cols(0, c2-c1);
+              Ap = Ai;
+              addMatMat (Ap, trans(Aj), MatrixView<T,ColMajor>(Cb));
+            }
+        }
+
+      if (num_chunks == 1)
+        store (range, Cb);
+      else
+        {
+          T * p = partial.data() + t*NB*NB;
+          for (size_t j = 0; j < j2-j1; j++)
+            for (size_t i = 0; i < i2-i1; i++)
+              p[j*NB+i] = Cb(i,j);
+        }
+    });
+
+    // at most 64 partial blocks
+    if (num_chunks > 1)
+      for (size_t blk = 0; blk < num_blocks; blk++)
+        store (blockRange(blk), [&](size_t i, size_t j)
+        {
+          T sum = 0;
+          for (size_t c = 0; c < num_chunks; c++)
+            sum += partial[(blk*num_chunks+c)*NB*NB + j*NB+i];
+          return sum;
+        });
+
+    if (mirror)
+      for (size_t j = 1; j < n; j++)
+        for (size_t i = 0; i < j; i++)
+          C(i,j) = C(j,i);
+  }
+
+
+
+  /*
+    Rank-1 update  A += alpha x y^T.
+
+    x and y are copied first (alpha applied), so they may be views
+    into A. A is streamed along its contiguous lines (columns for
+    ColMajor, rows for RowMajor) with unit-stride axpys; the lines
+    are distributed over the workers, and within a task the line
+    direction is blocked so the vector piece stays in L1 cache.
+  */
+  template <typename T, ORDERING ORD, typename TX, typename TY>
+  void RankOneUpdate (T alpha, const VecExpr<TX> & x, const VecExpr<TY> & y, MatrixView<T,ORD> A)
+  {
+    assert(A.rows() == x.size() && A.cols() == y.size());
+    constexpr size_t INNER_BLOCK = 16384;
+    constexpr size_t GRAIN = 1 << 18;     // entries per task
+
+    const size_t inner = (ORD == ColMajor) ? A.rows() : A.cols();
+    const size_t outer = (ORD == ColMajor) ? A.cols() : A.rows();
+    if (inner == 0 || outer == 0) return;
+
+    // A(line o) += v(o) * u
+    Vector<T> u(inner), v(outer);
+    if constexpr (ORD == ColMajor)
+      { u = alpha*x; v = y; }
+    else
+      { u = y; v = alpha*x; }
+
+    const size_t num_tasks = std::clamp<size_t>(inner*outer / GRAIN, 1, std::min<size_t>(outer, 64));
+    ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+    {
+      const size_t o1 = t*outer/num_tasks, o2 = (t+1)*outer/num_tasks;
+      const T * pu = u.data();
+      for (size_t i1 = 0; i1 < inner; i1 += INNER_BLOCK)
+        {
+          const size_t i2 = std::min(inner, i1+INNER_BLOCK);
+          for (size_t o = o1; o < o2; o++)
+            {
+              T * line = A.data() + o*A.dist();
+              const T vo = v(o);
+              for (size_t i = i1; i < i2; i++)
+                line[i] += vo * pu[i];
+            }
+        }
+    });
+  }
+
+
+  /*
+    Rank-k update  A += alpha X Y^T,  X: n x k,  Y: m x k, by the
+    parallel GEMM on ColMajor copies of the operands (for RowMajor A
+    on trans(A) += alpha Y X^T). k == 1 goes to RankOneUpdate.
+  */
+  template <typename T, ORDERING OX, ORDERING OY, ORDERING OA>
+  void RankKUpdate (T alpha, MatrixView<T,OX> X, MatrixView<T,OY> Y, MatrixView<T,OA> A)
+  {
+    assert(X.rows() == A.rows() && Y.rows() == A.cols() && X.cols() == Y.cols());
+    if (X.cols() == 1)
+      {
+        RankOneUpdate (alpha, X.col(0), Y.col(0), A);
+        return;
+      }
+
+    // C += alpha P Q^T for ColMajor C
+    auto update = [alpha] (auto P, auto Q, MatrixView<T,ColMajor> C)
+    {
+      Matrix<T,ColMajor> Pc(P.rows(), P.cols()), Qt(Q.cols(), Q.rows());
+      Pc = alpha*P;
+      Qt = trans(Q);
+      addMatMat_parallel (MatrixView<T,ColMajor>(Pc), MatrixView<T,ColMajor>(Qt), C);
+    };
+
+    if constexpr (OA == ColMajor)
+      update (X, Y, A);
+    else
+      update (Y, X, trans(A));
+  }
+
 } // namespace nanoblas
 
+#include "transpose.hpp"
 
 #endif
@@ -0,0 +1,181 @@
+#ifndef FILE_MIXED_PRECISION_HPP
+#define FILE_MIXED_PRECISION_HPP
+
+#include <cmath>
+#include <limits>
+#include <memory>
+
+#include "lapack_interface.hpp"
+
+
+namespace nanoblas
+{
+
+  /*
+    LU solver with mixed precision iterative refinement (as LAPACK's dsgesv):
+
+    A is factored in single precision (sgetrf_), every solve starts
+    with the single precision solution and refines it with residuals
+    computed in double precision:
+
+      r = b - A x,   solve A d = r  (single),   x += d
+
+    until |r|_inf <= |x|_inf |A|_inf eps sqrt(n). If this does not
+    happen within MAX_ITERATIONS steps, or if the single precision
+    factorization breaks down, the solver falls back to a double
+    precision LapackLU.
+  */
+
+  template <ORDERING ORD = ColMajor>
+  class MixedPrecisionLU
+  {
+    Matrix<double,ORD> a;
+    Matrix<float,ORD> af;
+    std::vector<integer> ipiv;
+    double anorm = 0;
+    std::unique_ptr<LapackLU<ORD>> fallback;
+    int num_iterations = 0;
+
+  public:
+    static constexpr int MAX_ITERATIONS = 30;
+
+    MixedPrecisionLU (Matrix<double,ORD> _a)
+      : a(std::move(_a)), af(a.rows(), a.cols()), ipiv(a.rows())
+    {
+      for (size_t i = 0; i < a.rows(); i++)
+        {
+          double rowsum = 0;
+          for (size_t j = 0; j < a.cols(); j++)
+            {
+              af(i,j) = static_cast<float>(a(i,j));
+              rowsum += std::abs(a(i,j));
+            }
+          anorm = std::max(anorm, rowsum);
+        }
+
+      integer n = a.rows();
+      if (n == 0) return;
+      integer lda = af.dist();
+      integer info;
+
+      // int sgetrf_(integer *m, integer *n, real *a, integer *lda,
+      //             integer *ipiv, integer *info);
+
+      sgetrf_(&n, &n, af.data(), &lda, ipiv.data(), &info);
+      if (info != 0)
+        fallback = std::make_unique<LapackLU<ORD>>(a);
+    }
+
+    // number of refinement steps of the last solve, -1 if it used the fallback
+    int iterations() const { return num_iterations; }
+    bool usesFallback() const { return fallback != nullptr; }
+
+    // b overwritten with A^{-1} b
+    template <typename TDIST>
+    void solve (VectorView<double,TDIST> b) {
+      CallWithColMajorRHS (b, [this](double * pb, integer nrhs, integer ldb)
+                           { refine (pb, nrhs, ldb); });
+    }
+
+    // all columns of b overwritten with A^{-1} b
+    template <ORDERING OB>
+    void solve (MatrixView<double,OB> b) {
+      CallWithColMajorRHS (b, [this](double * pb, integer nrhs, integer ldb)
+                           { refine (pb, nrhs, ldb); });
+    }
+
+  private:
+    // rf overwritten with the single precision A^{-1} rf
+    void solveSingle (Matrix<float,ColMajor> & rf) const {
+      char transa = (ORD == ColMajor) ? 'N' : 'T';
+      integer n = af.rows();
+      integer nrhs = rf.cols();
+      integer lda = af.dist();
+      integer ldb = rf.dist();
+      integer info;
+
+      // int sgetrs_(char *trans, integer *n, integer *nrhs, real *a,
+      //             integer *lda, integer *ipiv, real *b, integer *ldb,
+      //             integer *info);
+
+      sgetrs_(&transa, &n, &nrhs, (float*)af.data(), &lda, (integer*)ipiv.data(),
+              rf.data(), &ldb, &info);
+    }
+
+    void refine (double * pb, integer nrhs, integer ldb) {
+      const size_t n = a.rows();
+      if (n == 0 || nrhs == 0) return;
+      MatrixView<double,ColMajor> x(n, nrhs, ldb, pb);
+
+      Matrix<double,ColMajor> b(n, nrhs);
+      b = x;
+
+      if (!fallback)
+        {
+          const double tol = std::numeric_limits<double>::epsilon() * std::sqrt(double(n)) * anorm;
+
+          Matrix<float,ColMajor> rf(n, nrhs);
+          for (size_t j = 0; j < rf.cols(); j++)
+            for (size_t i = 0; i < n; i++)
+              rf(i,j) = static_cast<float>(b(i,j));
+          solveSingle (rf);
+          for (size_t j = 0; j < x.cols(); j++)
+            for (size_t i = 0; i < n; i++)
+              x(i,j) = rf(i,j);
+
+          Matrix<double,ColMajor> r(n, nrhs);
+          for (int it = 0; it <= MAX_ITERATIONS; it++)
+            {
+              // r = b - A x  in double precision
+              r = b;
+              char transa = (ORD == ColMajor) ? 'N' : 'T';
+              char transx = 'N';
+              integer n_ = n, nrhs_ = nrhs;
+              integer lda = a.dist();
+              integer ldx = ldb;
+              integer ldr = r.dist();
+              double alpha = -1, beta = 1;
+              gemm (&transa, &transx, &n_, &nrhs_, &n_, &alpha, a.data(), &lda,
+                    x.data(), &ldx, &beta, r.data(), &ldr);
+
+              bool converged = true;
+              for (size_t j = 0; j < r.cols() && converged; j++)
+                {
+                  double rmax = 0, xmax = 0;
+                  for (size_t i = 0; i < n; i++)
+                    {
+                      rmax = std::max(rmax, std::abs(r(i,j)));
+                      xmax = std::max(xmax, std::abs(x(i,j)));
+                    }
+                  converged = rmax <= xmax * tol;
+                }
+              if (converged)
+                {
+                  num_iterations = it;
+                  return;
+                }
+              if (it == MAX_ITERATIONS) break;
+
+              // x += A^{-1} r  in single precision
+              for (size_t j = 0; j < rf.cols(); j++)
+                for (size_t i = 0; i < n; i++)
+                  rf(i,j) = static_cast<float>(r(i,j));
+              solveSingle (rf);
+              for (size_t j = 0; j < x.cols(); j++)
+                for (size_t i = 0; i < n; i++)
+                  x(i,j) += rf(i,j);
+            }
+
+          // refinement did not converge, from now on use double precision
+          fallback = std::make_unique<LapackLU<ORD>>(a);
+        }
+
+      num_iterations = -1;
+      x = b;
+      fallback->solve(x);
+    }
+  };
+
+}
+
+#endif
@@ -0,0 +1,496 @@
+#ifndef FILE_PACKED_HPP
+#define FILE_PACKED_HPP
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "vector.hpp"
+#include "matrix.hpp"
+#include "triangular.hpp"
+
+
+namespace nanoblas
+{
+
+  /*
+    Block packed storage of the lower triangle of an n x n matrix:
+
+      the lower block triangle is split into NB x NB tiles,
+      tile (I,J), J <= I, is stored contiguously in ColMajor order at
+      offset (I(I+1)/2 + J) * NB*NB.
+
+    Needs n^2/2 + n NB/2 entries instead of n^2 (the upper halves of
+    the diagonal tiles and the padding of the last tile row are not
+    used). Every tile is a dense ColMajor block with leading
+    dimension NB, so the kernels below run unit-stride loops and
+    GEMM (addMatMat) on whole tiles.
+  */
+
+  constexpr size_t PACKED_BLOCKSIZE = 64;
+
+  template <typename T = double>
+  class BlockPackedLower
+  {
+  protected:
+    static constexpr size_t NB = PACKED_BLOCKSIZE;
+    size_t m_n, m_nb;
+    std::vector<T> m_data;
+
+    explicit BlockPackedLower (size_t n)
+      : m_n(n), m_nb((n+NB-1)/NB), m_data(m_nb*(m_nb+1)/2*NB*NB, T(0)) { }
+
+    static size_t tileIndex (size_t I, size_t J) { return I*(I+1)/2 + J; }
+
+  public:
+    size_t rows() const { return m_n; }
+    size_t cols() const { return m_n; }
+    size_t numBlocks() const { return m_nb; }
+    size_t blockSize (size_t I) const { return std::min(NB, m_n - I*NB); }
+    size_t numStored() const { return m_data.size(); }
+
+    const T * tileData (size_t I, size_t J) const { return m_data.data() + tileIndex(I,J)*NB*NB; }
+    T * tileData (size_t I, size_t J) { return m_data.data() + tileIndex(I,J)*NB*NB; }
+
+    // tile (I,J), J <= I
+    MatrixView<T,ColMajor> tile (size_t I, size_t J) const
+    {
+      return { blockSize(I), blockSize(J), NB, const_cast<T*>(tileData(I,J)) };
+    }
+
+    // entry (i,j) of the lower triangle, i >= j
+    T & lower (size_t i, size_t j)
+    {
+      assert(i >= j && i < m_n);
+      return m_data[tileIndex(i/NB, j/NB)*NB*NB + (i%NB) + (j%NB)*NB];
+    }
+    const T & lower (size_t i, size_t j) const
+    {
+      assert(i >= j && i < m_n);
+      return m_data[tileIndex(i/NB, j/NB)*NB*NB + (i%NB) + (j%NB)*NB];
+    }
+  };
+
+
+  // symmetric matrix, lower triangle in block packed storage
+  template <typename T = double>
+  class SymmetricPackedMatrix : public BlockPackedLower<T>
+  {
+    using BASE = BlockPackedLower<T>;
+    using BASE::m_n;
+
+  public:
+    explicit SymmetricPackedMatrix (size_t n) : BASE(n) { }
+
+    // the lower triangle of A is referenced
+    template <ORDERING ORD>
+    explicit SymmetricPackedMatrix (MatrixView<T,ORD> A)
+      : BASE(A.rows())
+    {
+      if (A.rows() != A.cols())
+        throw std::invalid_argument("SymmetricPackedMatrix: matrix must be square");
+      for (size_t j = 0; j < m_n; j++)
+        for (size_t i = j; i < m_n; i++)
+          this->lower(i,j) = A(i,j);
+    }
+
+    T & operator() (size_t i, size_t j) { return (i >= j) ? this->lower(i,j) : this->lower(j,i); }
+    const T & operator() (size_t i, size_t j) const { return (i >= j) ? this->lower(i,j) : this->lower(j,i); }
+
+    template <ORDERING ORD>
+    void copyTo (MatrixView<T,ORD> A) const
+    {
+      assert(A.rows() == m_n && A.cols() == m_n);
+      for (size_t j = 0; j < m_n; j++)
+        for (size_t i = j; i < m_n; i++)
+          A(i,j) = A(j,i) = this->lower(i,j);
+    }
+
+    Matrix<T> toDense () const
+    {
+      Matrix<T> A(m_n, m_n);
+      copyTo (MatrixView<T,RowMajor>(A));
+      return A;
+    }
+  };
+
+
+  // lower triangular matrix in block packed storage, upper triangles via the Trans functions
+  template <typename T = double>
+  class TriangularPackedMatrix : public BlockPackedLower<T>
+  {
+    using BASE = BlockPackedLower<T>;
+    using BASE::m_n;
+
+    template <typename> friend class PackedCholesky;
+    explicit TriangularPackedMatrix (BASE && storage) : BASE(std::move(storage)) { }
+
+  public:
+    explicit TriangularPackedMatrix (size_t n) : BASE(n) { }
+
+    template <ORDERING ORD>
+    explicit TriangularPackedMatrix (MatrixView<T,ORD> A)
+      : BASE(A.rows())
+    {
+      if (A.rows() != A.cols())
+        throw std::invalid_argument("TriangularPackedMatrix: matrix must be square");
+      for (size_t j = 0; j < m_n; j++)
+        for (size_t i = j; i < m_n; i++)
+          this->lower(i,j) = A(i,j);
+    }
+
+    T operator() (size_t i, size_t j) const { return (i >= j) ? this->lower(i,j) : T(0); }
+
+    template <ORDERING ORD>
+    void copyTo (MatrixView<T,ORD> A) const
+    {
+      assert(A.rows() == m_n && A.cols() == m_n);
+      for (size_t j = 0; j < m_n; j++)
+        for (size_t i = 0; i < m_n; i++)
+          A(i,j) = (*this)(i,j);
+    }
+
+    Matrix<T> toDense () const
+    {
+      Matrix<T> A(m_n, m_n);
+      copyTo (MatrixView<T,RowMajor>(A));
+      return A;
+    }
+  };
+
+
+  // ************************* tile kernels *******************
+
+  // yi += A xj,  yj += A^T xi,  A: r x c ColMajor with leading dimension dist
+  template <typename T>
+  inline void SymmetricTileMult (const T * a, size_t r, size_t c, size_t dist,
+                                 const T * xi, const T * xj, T * yi, T * yj)
+  {
+    for (size_t cc = 0; cc < c; cc++)
+      {
+        const T * col = a + cc*dist;
+        const T xc = xj[cc];
+        T sum = 0;
+        for (size_t rr = 0; rr < r; rr++)
+          {
+            yi[rr] += col[rr] * xc;
+            sum += col[rr] * xi[rr];
+          }
+        yj[cc] += sum;
+      }
+  }
+
+  // y += A x for a diagonal tile, lower triangle of A referenced
+  template <typename T>
+  inline void SymmetricDiagTileMult (const T * a, size_t r, size_t dist, const T * x, T * y)
+  {
+    for (size_t cc = 0; cc < r; cc++)
+      {
+        const T * col = a + cc*dist;
+        const T xc = x[cc];
+        T sum = col[cc] * xc;
+        for (size_t rr = cc+1; rr < r; rr++)
+          {
+            y[rr] += col[rr] * xc;
+            sum += col[rr] * x[rr];
+          }
+        y[cc] += sum;
+      }
+  }
+
+
+  // ************************* SYMV *******************
+
+  // y = A x, only the lower triangle of the dense matrix A is referenced, one pass over it
+  template <typename T, ORDERING ORD, typename TDX, typename TDY>
+  void SymmetricMatVec (MatrixView<T,ORD> A, VectorView<T,TDX> x, VectorView<T,TDY> y)
+  {
+    assert(A.rows() == A.cols() && A.cols() == x.size() && A.rows() == y.size());
+    const size_t n = A.rows();
+    y = T(0);
+    if constexpr (ORD == ColMajor)
+      for (size_t j = 0; j < n; j++)
+        {
+          const T xj = x(j);
+          T sum = A(j,j) * xj;
+          for (size_t i = j+1; i < n; i++)
+            {
+              y(i) += A(i,j) * xj;
+              sum += A(i,j) * x(i);
+            }
+          y(j) += sum;
+        }
+    else
+      for (size_t i = 0; i < n; i++)
+        {
+          const T xi = x(i);
+          T sum = A(i,i) * xi;
+          for (size_t j = 0; j < i; j++)
+            {
+              sum += A(i,j) * x(j);
+              y(j) += A(i,j) * xi;
+            }
+          y(i) += sum;
+        }
+  }
+
+
+  /*
+    y = A x for block packed symmetric A (SPMV), every tile is read
+    once and used for both of its products. The block rows are
+    distributed over the workers, balanced by their number of tiles;
+    every task accumulates into a private vector, which are summed up
+    afterwards.
+  */
+  template <typename T>
+  void SymmetricPackedMatVec (const SymmetricPackedMatrix<T> & A, VectorView<T> x, VectorView<T> y)
+  {
+    assert(A.rows() == x.size() && A.rows() == y.size());
+    constexpr size_t NB = PACKED_BLOCKSIZE;
+    constexpr size_t GRAIN = 256;     // tiles per task
+    const size_t n = A.rows();
+    const size_t nb = A.numBlocks();
+    const size_t num_tiles = nb*(nb+1)/2;
+    const size_t num_tasks = std::max<size_t>(1, std::min({ num_tiles / GRAIN, nb, size_t(64) }));
+
+    // block rows [part[t], part[t+1]) with about num_tiles/num_tasks tiles
+    std::vector<size_t> part(num_tasks+1, nb);
+    part[0] = 0;
+    for (size_t t = 1, I = 0; t < num_tasks; t++)
+      {
+        while (I < nb && (I+1)*(I+2)/2 < t*num_tiles/num_tasks) I++;
+        part[t] = std::max(part[t-1], I);
+      }
+
+    std::vector<T> buffer(num_tasks*n, T(0));
+    const T * px = x.data();
+
+    ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+    {
+      T * yt = buffer.data() + t*n;
+      for (size_t I = part[t]; I < part[t+1]; I++)
+        {
+          const size_t bi = A.blockSize(I);
+          for (size_t J = 0; J < I; J++)
+            SymmetricTileMult (A.tileData(I,J), bi, NB, NB,
+                               px+I*NB, px+J*NB, yt+I*NB, yt+J*NB);
+          SymmetricDiagTileMult (A.tileData(I,I), bi, NB, px+I*NB, yt+I*NB);
+        }
+    });
+
+    const size_t num_sum = (n + 4095) / 4096;
+    ASC_HPC::RunParallel(static_cast<int>(num_sum), [&](int t, int /*ntasks*/)
+    {
+      for (size_t i = t*4096; i < std::min(n, size_t(t+1)*4096); i++)
+        {
+          T sum = 0;
+          for (size_t s = 0; s < num_tasks; s++)
+            sum += buffer[s*n+i];
+          y(i) = sum;
+        }
+    });
+  }
+
+
+  // ************************* triangular packed kernels *******************
+
+  // y = L x, parallel over block rows
+  template <typename T>
+  void TriangularPackedMatVec (const TriangularPackedMatrix<T> & L, VectorView<T> x, VectorView<T> y)
+  {
+    constexpr size_t NB = PACKED_BLOCKSIZE;
+    const size_t nb = L.numBlocks();
+    ASC_HPC::RunParallel(static_cast<int>(nb), [&](int I, int /*ntasks*/)
+    {
+      const size_t bi = L.blockSize(I);
+      auto yI = y.range(I*NB, I*NB+bi);
+      yI = T(0);
+      for (size_t J = 0; J < size_t(I); J++)
+        {
+          auto t = L.tile(I,J);
+          for (size_t c = 0; c < NB; c++)
+            yI += x(J*NB+c) * t.col(c);
+        }
+      auto d = L.tile(I,I);
+      for (size_t c = 0; c < bi; c++)
+        for (size_t r = c; r < bi; r++)
+          yI(r) += d(r,c) * x(I*NB+c);
+    });
+  }
+
+  // y = L^T x, parallel over block columns
+  template <typename T>
+  void TriangularPackedMatVecTrans (const TriangularPackedMatrix<T> & L, VectorView<T> x, VectorView<T> y)
+  {
+    constexpr size_t NB = PACKED_BLOCKSIZE;
+    const size_t nb = L.numBlocks();
+    ASC_HPC::RunParallel(static_cast<int>(nb), [&](int J, int /*ntasks*/)
+    {
+      const size_t bj = L.blockSize(J);
+      auto d = L.tile(J,J);
+      for (size_t c = 0; c < bj; c++)
+        {
+          T sum = 0;
+          for (size_t r = c; r < bj; r++)
+            sum += d(r,c) * x(J*NB+r);
+          y(J*NB+c) = sum;
+        }
+      for (size_t I = J+1; I < nb; I++)
+        {
+          auto t = L.tile(I,J);
+          auto xI = x.range(I*NB, I*NB+L.blockSize(I));
+          for (size_t c = 0; c < bj; c++)
+            y(J*NB+c) += dot(t.col(c), xI);
+        }
+    });
+  }
+
+  // b overwritten with L^{-1} b
+  template <typename T, typename TDIST>
+  void TriangularPackedSolve (const TriangularPackedMatrix<T> & L, VectorView<T,TDIST> b)
+  {
+    constexpr size_t NB = PACKED_BLOCKSIZE;
+    for (size_t I = 0; I < L.numBlocks(); I++)
+      {
+        auto bI = b.range(I*NB, I*NB+L.blockSize(I));
+        for (size_t J = 0; J < I; J++)
+          {
+            auto t = L.tile(I,J);
+            for (size_t c = 0; c < NB; c++)
+              bI -= b(J*NB+c) * t.col(c);
+          }
+        TriangularSolve<Lower> (L.tile(I,I), bI);
+      }
+  }
+
+  // b overwritten with L^{-T} b
+  template <typename T, typename TDIST>
+  void TriangularPackedSolveTrans (const TriangularPackedMatrix<T> & L, VectorView<T,TDIST> b)
+  {
+    constexpr size_t NB = PACKED_BLOCKSIZE;
+    for (size_t J = L.numBlocks(); J-- > 0; )
+      {
+        auto bJ = b.range(J*NB, J*NB+L.blockSize(J));
+        for (size_t I = J+1; I < L.numBlocks(); I++)
+          {
+            auto t = L.tile(I,J);
+            auto bI = b.range(I*NB, I*NB+L.blockSize(I));
+            for (size_t c = 0; c < L.blockSize(J); c++)
+              bJ(c) -= dot(t.col(c), bI);
+          }
+        TriangularSolve<Upper> (trans(L.tile(J,J)), bJ);
+      }
+  }
+
+
+  // ************************* packed Cholesky *******************
+
+  /*
+    A = L L^T in block packed storage, right-looking over the tile
+    columns: the diagonal tile is factored, the tiles below are
+    solved with it (TRSM), and the trailing tiles are updated by GEMM
+    tasks of a few tiles each. A is moved in and its storage is
+    overwritten with the factor, so neither a dense n x n matrix nor
+    a second packed matrix is ever needed:
+
+      PackedCholesky<double> chol(std::move(A));
+  */
+  template <typename T = double>
+  class PackedCholesky
+  {
+    TriangularPackedMatrix<T> L;
+    static constexpr size_t NB = PACKED_BLOCKSIZE;
+
+  public:
+    explicit PackedCholesky (SymmetricPackedMatrix<T> && A)
+      : L(std::move(static_cast<BlockPackedLower<T>&>(A)))
+    {
+      const size_t nb = L.numBlocks();
+      Matrix<T,ColMajor> buffer(NB, NB);
+
+      for (size_t K = 0; K < nb; K++)
+        {
+          const size_t bk = L.blockSize(K);
+          auto D = L.tile(K,K);
+
+          // diagonal tile
+          for (size_t j = 0; j < bk; j++)
+            {
+              T djj = D(j,j);
+              for (size_t l = 0; l < j; l++)
+                djj -= D(j,l)*D(j,l);
+              if (!(djj > 0))
+                throw std::runtime_error("PackedCholesky: matrix not positive definite, pivot "
+                                         + std::to_string(K*NB+j));
+              djj = std::sqrt(djj);
+              D(j,j) = djj;
+              for (size_t i = j+1; i < bk; i++)
+                {
+                  T sum = D(i,j);
+                  for (size_t l = 0; l < j; l++)
+                    sum -= D(i,l)*D(j,l);
+                  D(i,j) = sum / djj;
+                }
+            }
+
+          // tiles below: X D^T = B  <=>  D X^T = B^T
+          if (K+1 == nb) break;
+          ASC_HPC::RunParallel(static_cast<int>(nb-K-1), [&](int t, int /*ntasks*/)
+          {
+            const size_t I = K+1+t;
+            auto B = L.tile(I,K);
+            Matrix<T,ColMajor> Xt(bk, B.rows());
+            Xt = trans(B);
+            TriangularSolveColMajor<Lower,NonUnit> (D, MatrixView<T,ColMajor>(Xt));
+            B = trans(MatrixView<T,ColMajor>(Xt));
+          });
+
+          // trailing tiles: (I,J) -= (I,K) (J,K)^T,  K < J <= I
+          const size_t m = nb-K-1;
+          std::vector<T> negT(m*NB*NB);    // -(J,K)^T, ColMajor bk x NB
+          ASC_HPC::RunParallel(static_cast<int>(m), [&](int t, int /*ntasks*/)
+          {
+            const size_t J = K+1+t;
+            auto B = L.tile(J,K);
+            MatrixView<T,ColMajor> W(bk, B.rows(), NB, negT.data()+t*NB*NB);
+            for (size_t j = 0; j < B.rows(); j++)
+              for (size_t l = 0; l < bk; l++)
+                W(l,j) = -B(j,l);
+          });
+
+          constexpr size_t GRAIN = 16;     // tiles per task
+          const size_t num_pairs = m*(m+1)/2;
+          ASC_HPC::RunParallel(static_cast<int>((num_pairs+GRAIN-1)/GRAIN), [&](int t, int /*ntasks*/)
+          {
+            const size_t first = t*GRAIN, next = std::min(num_pairs, first+GRAIN);
+            size_t i = 0;
+            while ((i+1)*(i+2)/2 <= first) i++;
+            size_t j = first - i*(i+1)/2;
+            for (size_t p = first; p < next; p++)
+              {
+                const size_t I = K+1+i, J = K+1+j;
+                MatrixView<T,ColMajor> W(bk, L.blockSize(J), NB, negT.data()+j*NB*NB);
+                addMatMat (L.tile(I,K), W, L.tile(I,J));
+                if (++j > i) { i++; j = 0; }
+              }
+          });
+        }
+    }
+
+    size_t size() const { return L.rows(); }
+    const TriangularPackedMatrix<T> & LFactor() const { return L; }
+
+    // b overwritten with A^{-1} b
+    template <typename TDIST>
+    void solve (VectorView<T,TDIST> b) const
+    {
+      TriangularPackedSolve (L, b);
+      TriangularPackedSolveTrans (L, b);
+    }
+  };
+
+}
+
+#endif
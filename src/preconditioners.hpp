@@ -0,0 +1,358 @@
+#ifndef FILE_PRECONDITIONERS_HPP
+#define FILE_PRECONDITIONERS_HPP
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "sparse.hpp"
+#include "batched.hpp"
+#include "krylov.hpp"
+
+
+namespace nanoblas
+{
+
+  /*
+    Preconditioners for the Krylov solvers. The setup is done in the
+    constructor, apply(x, y) computes y = M^{-1} x and can be called
+    for any number of solves. Dense matrices are accepted as
+    MatrixView, sparse ones in CSR format.
+  */
+
+
+  // ************************* Jacobi *******************
+
+  template <typename T = double>
+  class JacobiPreconditioner
+  {
+    Vector<T> invdiag;
+
+  public:
+    template <ORDERING ORD>
+    explicit JacobiPreconditioner (MatrixView<T,ORD> A)
+      : invdiag(A.rows())
+    {
+      auto d = A.diag();
+      for (size_t i = 0; i < d.size(); i++)
+        invdiag(i) = T(1) / d(i);
+    }
+
+    explicit JacobiPreconditioner (const SparseMatrix<T> & A)
+      : invdiag(A.rows())
+    {
+      for (size_t i = 0; i < A.rows(); i++)
+        invdiag(i) = T(1) / A(i,i);
+    }
+
+    // y = D^{-1} x
+    void apply (VectorView<T> x, VectorView<T> y) const
+    {
+      const T * pd = invdiag.data();
+      const T * px = x.data();
+      T * py = y.data();
+      ParallelForRange (x.size(), [=](size_t i1, size_t i2)
+      {
+        for (size_t i = i1; i < i2; i++)
+          py[i] = pd[i] * px[i];
+      });
+    }
+  };
+
+
+  // ************************* block Jacobi *******************
+
+  /*
+    Inverts the diagonal blocks [k*bs, (k+1)*bs) with BatchedLU.
+    A last incomplete block is padded with the identity.
+  */
+  template <typename T = double>
+  class BlockJacobiPreconditioner
+  {
+    size_t m_n, m_bs;
+    BatchedLU<T> lu;
+    mutable std::vector<T> buffer;    // bs x num_blocks, ColMajor
+
+    template <typename TA>
+    void setup (const TA & getEntry)
+    {
+      for (size_t k = 0; k < lu.batchSize(); k++)
+        for (size_t i = 0; i < m_bs; i++)
+          for (size_t j = 0; j < m_bs; j++)
+            {
+              const size_t gi = k*m_bs+i, gj = k*m_bs+j;
+              lu(k,i,j) = (gi < m_n && gj < m_n) ? getEntry(gi, gj) : T(i == j);
+            }
+      lu.factor();
+      for (size_t k = 0; k < lu.batchSize(); k++)
+        if (lu.info(k) != 0)
+          throw std::runtime_error("BlockJacobiPreconditioner: block " + std::to_string(k) + " is singular");
+    }
+
+  public:
+    template <ORDERING ORD>
+    BlockJacobiPreconditioner (MatrixView<T,ORD> A, size_t bs)
+      : m_n(A.rows()), m_bs(bs), lu(bs, (A.rows()+bs-1)/bs), buffer(bs*lu.batchSize())
+    {
+      setup ([&A](size_t i, size_t j) { return A(i,j); });
+    }
+
+    BlockJacobiPreconditioner (const SparseMatrix<T> & A, size_t bs)
+      : m_n(A.rows()), m_bs(bs), lu(bs, (A.rows()+bs-1)/bs), buffer(bs*lu.batchSize())
+    {
+      setup ([&A](size_t i, size_t j) { return A(i,j); });
+    }
+
+    size_t blockSize() const { return m_bs; }
+
+    // y = blockdiag(A)^{-1} x, not reentrant (shared buffer)
+    void apply (VectorView<T> x, VectorView<T> y) const
+    {
+      std::fill (buffer.begin()+m_n, buffer.end(), T(0));
+      for (size_t i = 0; i < m_n; i++)
+        buffer[i] = x(i);
+      lu.solveStrided (buffer.data(), m_bs);
+      for (size_t i = 0; i < m_n; i++)
+        y(i) = buffer[i];
+    }
+  };
+
+
+  // ************************* SSOR *******************
+
+  /*
+    Symmetric successive over-relaxation,
+
+      M = omega/(2-omega) (D/omega + L) D^{-1} (D/omega + U),
+
+    one forward and one backward Gauss-Seidel sweep per application.
+    The sweeps are sequential; for parallel smoothing prefer ILU(0)
+    with level scheduling or block Jacobi.
+  */
+  template <typename T = double>
+  class SSORPreconditioner
+  {
+    SparseMatrix<T> a;
+    std::vector<size_t> diagpos;
+    T m_omega;
+
+  public:
+    SSORPreconditioner (SparseMatrix<T> A, T omega = 1)
+      : a(std::move(A)), diagpos(a.rows()), m_omega(omega)
+    {
+      if (omega <= T(0) || omega >= T(2))
+        throw std::invalid_argument("SSORPreconditioner: omega must be in (0,2)");
+      const auto & ind = a.colInd();
+      for (size_t i = 0; i < a.rows(); i++)
+        {
+          auto pos = std::lower_bound(ind.begin()+a.first(i), ind.begin()+a.next(i), i);
+          if (pos == ind.begin()+a.next(i) || *pos != i || a.values()[pos-ind.begin()] == T(0))
+            throw std::runtime_error("SSORPreconditioner: zero diagonal in row " + std::to_string(i));
+          diagpos[i] = pos - ind.begin();
+        }
+    }
+
+    template <ORDERING ORD>
+    SSORPreconditioner (MatrixView<T,ORD> A, T omega = 1)
+      : SSORPreconditioner (SparseMatrix<T>(A), omega) { }
+
+    void apply (VectorView<T> x, VectorView<T> y) const
+    {
+      const auto & ind = a.colInd();
+      const auto & val = a.values();
+      const size_t n = a.rows();
+
+      // (D/omega + L) u = x
+      for (size_t i = 0; i < n; i++)
+        {
+          T sum = x(i);
+          for (size_t k = a.first(i); k < diagpos[i]; k++)
+            sum -= val[k] * y(ind[k]);
+          y(i) = sum * m_omega / val[diagpos[i]];
+        }
+
+      // u *= (2-omega)/omega D
+      for (size_t i = 0; i < n; i++)
+        y(i) *= (T(2)-m_omega) / m_omega * val[diagpos[i]];
+
+      // (D/omega + U) y = u
+      for (size_t i = n; i-- > 0; )
+        {
+          T sum = y(i);
+          for (size_t k = diagpos[i]+1; k < a.next(i); k++)
+            sum -= val[k] * y(ind[k]);
+          y(i) = sum * m_omega / val[diagpos[i]];
+        }
+    }
+  };
+
+
+  // ************************* ILU(0) *******************
+
+  /*
+    Incomplete LU factorization without fill-in, L unit lower and U
+    stored in the pattern of A.
+
+    Level scheduling: row i of the forward substitution (and of the
+    factorization) depends on the rows k < i of its L-part, so all
+    rows with the same level
+
+      level(i) = 1 + max { level(k) : A(i,k) != 0, k < i }
+
+    are independent and are processed in parallel; the backward
+    substitution uses the levels of the U-part from the bottom. For
+    the 5-point stencil on an m x m grid there are 2m-1 levels.
+  */
+  template <typename T = double>
+  class ILU0Preconditioner
+  {
+    SparseMatrix<T> lu;
+    std::vector<size_t> diagpos;
+    std::vector<size_t> lowptr, lowrows;      // rows of level l: lowrows[lowptr[l] .. lowptr[l+1])
+    std::vector<size_t> upptr, uprows;
+
+    static constexpr size_t LEVEL_GRAIN = 1024;
+
+    // func(i) for all rows, level by level
+    template <typename FUNC>
+    static void forLevels (const std::vector<size_t> & ptr, const std::vector<size_t> & rows, FUNC && func)
+    {
+      for (size_t l = 0; l+1 < ptr.size(); l++)
+        {
+          const size_t first = ptr[l], num = ptr[l+1]-ptr[l];
+          if (num < 2*LEVEL_GRAIN)
+            {
+              for (size_t k = first; k < first+num; k++)
+                func(rows[k]);
+              continue;
+            }
+          const size_t num_tasks = num / LEVEL_GRAIN;
+          ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+          {
+            for (size_t k = first+t*num/num_tasks; k < first+(t+1)*num/num_tasks; k++)
+              func(rows[k]);
+          });
+        }
+    }
+
+    static void groupLevels (const std::vector<size_t> & level,
+                             std::vector<size_t> & ptr, std::vector<size_t> & rows)
+    {
+      const size_t num_levels = level.empty() ? 0 : *std::max_element(level.begin(), level.end())+1;
+      ptr.assign(num_levels+1, 0);
+      for (size_t l : level) ptr[l+1]++;
+      for (size_t l = 0; l < num_levels; l++) ptr[l+1] += ptr[l];
+      rows.resize(level.size());
+      std::vector<size_t> pos(ptr.begin(), ptr.end()-1);
+      for (size_t i = 0; i < level.size(); i++)
+        rows[pos[level[i]]++] = i;
+    }
+
+  public:
+    explicit ILU0Preconditioner (const SparseMatrix<T> & A)
+      : lu(A), diagpos(A.rows())
+    {
+      if (A.rows() != A.cols())
+        throw std::invalid_argument("ILU0Preconditioner: matrix must be square");
+
+      const size_t n = lu.rows();
+      const auto & ind = lu.colInd();
+      std::vector<size_t> level(n, 0);
+      for (size_t i = 0; i < n; i++)
+        {
+          auto pos = std::lower_bound(ind.begin()+lu.first(i), ind.begin()+lu.next(i), i);
+          if (pos == ind.begin()+lu.next(i) || *pos != i)
+            throw std::runtime_error("ILU0Preconditioner: no diagonal entry in row " + std::to_string(i));
+          diagpos[i] = pos - ind.begin();
+          for (size_t k = lu.first(i); k < diagpos[i]; k++)
+            level[i] = std::max(level[i], level[ind[k]]+1);
+        }
+      groupLevels (level, lowptr, lowrows);
+
+      std::fill (level.begin(), level.end(), 0);
+      for (size_t i = n; i-- > 0; )
+        for (size_t k = diagpos[i]+1; k < lu.next(i); k++)
+          level[i] = std::max(level[i], level[ind[k]]+1);
+      groupLevels (level, upptr, uprows);
+
+      factor();
+    }
+
+    template <ORDERING ORD>
+    explicit ILU0Preconditioner (MatrixView<T,ORD> A)
+      : ILU0Preconditioner (SparseMatrix<T>(A)) { }
+
+    // new values of A with the same pattern (checked, O(nnz)), the level analysis is reused
+    void refactor (const SparseMatrix<T> & A)
+    {
+      if (A.rows() != lu.rows() || A.cols() != lu.cols()
+          || A.rowPtr() != lu.rowPtr() || A.colInd() != lu.colInd())
+        throw std::invalid_argument("ILU0Preconditioner::refactor: pattern does not match");
+      lu.values() = A.values();
+      factor();
+    }
+
+    // IKJ elimination restricted to the pattern, rows of a level in parallel
+    void factor ()
+    {
+      const auto & ind = lu.colInd();
+      auto & val = lu.values();
+      const size_t n = lu.rows();
+
+      forLevels (lowptr, lowrows, [&](size_t i)
+      {
+        for (size_t k = lu.first(i); k < diagpos[i]; k++)
+          {
+            const size_t kk = ind[k];
+            const T lik = val[k] / val[diagpos[kk]];
+            val[k] = lik;
+
+            // row i -= lik * U-part of row kk, both sorted: merge
+            size_t p = k+1;
+            for (size_t q = diagpos[kk]+1; q < lu.next(kk); q++)
+              {
+                while (p < lu.next(i) && ind[p] < ind[q]) p++;
+                if (p == lu.next(i)) break;
+                if (ind[p] == ind[q])
+                  val[p] -= lik * val[q];
+              }
+          }
+      });
+
+      for (size_t i = 0; i < n; i++)
+        if (val[diagpos[i]] == T(0))
+          throw std::runtime_error("ILU0Preconditioner: zero pivot in row " + std::to_string(i));
+    }
+
+    const SparseMatrix<T> & factors() const { return lu; }
+    size_t numLowerLevels() const { return lowptr.size()-1; }
+    size_t numUpperLevels() const { return upptr.size()-1; }
+
+    // y = (LU)^{-1} x
+    void apply (VectorView<T> x, VectorView<T> y) const
+    {
+      const auto & ind = lu.colInd();
+      const auto & val = lu.values();
+
+      forLevels (lowptr, lowrows, [&](size_t i)
+      {
+        T sum = x(i);
+        for (size_t k = lu.first(i); k < diagpos[i]; k++)
+          sum -= val[k] * y(ind[k]);
+        y(i) = sum;
+      });
+
+      forLevels (upptr, uprows, [&](size_t i)
+      {
+        T sum = y(i);
+        for (size_t k = diagpos[i]+1; k < lu.next(i); k++)
+          sum -= val[k] * y(ind[k]);
+        y(i) = sum / val[diagpos[i]];
+      });
+    }
+  };
+
+}
+
+#endif
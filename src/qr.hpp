@@ -0,0 +1,333 @@
+#ifndef FILE_QR_HPP
+#define FILE_QR_HPP
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+
+#include "vector.hpp"
+#include "matrix.hpp"
+
+
+namespace nanoblas
+{
+
+  /*
+    Native blocked Householder QR factorization A = Q R.
+
+    A panel of NB columns is factored column by column, its reflectors
+    H_j = I - tau_j v_j v_j^T are accumulated into the compact WY form
+
+       H_k1 ... H_k2-1 = I - V T V^T     (T upper triangular),
+
+    and the block reflector is applied to the trailing columns
+    by GEMM calls (addMatMat):   C -= V (T^T (V^T C)).
+  */
+
+  constexpr size_t QR_BLOCKSIZE = 32;
+
+
+  template <typename T = double>
+  class QR
+  {
+    Matrix<T,ColMajor> A;     // R on and above the diagonal, v_j below
+    Vector<T> tau;
+    Matrix<T,ColMajor> Ts;    // T-factors of the panels, side by side
+
+    size_t numReflectors() const { return tau.size(); }
+
+
+    // the unit lower trapezoidal reflector block V of panel [k1,k2), ColMajor
+    Matrix<T,ColMajor> panelV (size_t k1, size_t k2) const
+    {
+      const size_t m = A.rows();
+      Matrix<T,ColMajor> V(m-k1, k2-k1);
+      for (size_t l = 0; l < k2-k1; l++)
+        for (size_t i = 0; i < m-k1; i++)
+          V(i,l) = (i < l) ? T(0) : (i == l) ? T(1) : A(k1+i, k1+l);
+      return V;
+    }
+
+
+    // C overwritten with (I - V T V^T) C  or  (I - V T^T V^T) C
+    void applyBlockReflector (size_t k1, size_t k2, MatrixView<T,ColMajor> C,
+                              bool transposed) const
+    {
+      const size_t nb = k2 - k1;
+      const size_t mr = A.rows() - k1;
+      const size_t nc = C.cols();
+      if (nc == 0 || nb == 0) return;
+
+      Matrix<T,ColMajor> V = panelV(k1, k2);
+      Matrix<T,ColMajor> Vt(nb, mr);
+      Matrix<T,ColMajor> negV(mr, nb);
+      for (size_t l = 0; l < nb; l++)
+        for (size_t i = 0; i < mr; i++)
+          {
+            Vt(l,i) = V(i,l);
+            negV(i,l) = -V(i,l);
+          }
+      auto T_ = Ts.cols(k1, k2).rows(0, nb);
+
+      constexpr size_t GRAIN = 48;
+      const size_t num_tasks = (nc + GRAIN - 1) / GRAIN;
+
+      ASC_HPC::RunParallel(static_cast<int>(num_tasks),
+                           [&](int t, int /*ntasks*/)
+      {
+        const size_t c1 = static_cast<size_t>(t) * GRAIN;
+        const size_t c2 = std::min(nc, c1 + GRAIN);
+        auto Csub = C.cols(c1, c2);
+
+        // W = V^T C
+        Matrix<T,ColMajor> W(nb, c2-c1);
+        W = T(0);
+        addMatMat(MatrixView<T,ColMajor>(Vt), Csub, MatrixView<T,ColMajor>(W));
+
+        // W = T W  or  T^T W,  T upper triangular
+        for (size_t c = 0; c < W.cols(); c++)
+          {
+            auto w = W.col(c);
+            if (transposed)
+              for (size_t i = nb; i-- > 0; )
+                {
+                  T sum = 0;
+                  for (size_t l = 0; l <= i; l++)
+                    sum += T_(l,i) * w(l);
+                  w(i) = sum;
+                }
+            else
+              for (size_t i = 0; i < nb; i++)
+                {
+                  T sum = 0;
+                  for (size_t l = i; l < nb; l++)
+                    sum += T_(i,l) * w(l);
+                  w(i) = sum;
+                }
+          }
+
+        // C -= V W
+        addMatMat(MatrixView<T,ColMajor>(negV), MatrixView<T,ColMajor>(W), Csub);
+      });
+    }
+
+  public:
+    template <ORDERING ORD>
+    QR (MatrixView<T,ORD> _A)
+      : A(_A.rows(), _A.cols()), tau(std::min(_A.rows(), _A.cols())),
+        Ts(QR_BLOCKSIZE, std::min(_A.rows(), _A.cols()))
+    {
+      A = _A;
+      Ts = T(0);
+
+      const size_t m = A.rows();
+      const size_t n = A.cols();
+      const size_t k = numReflectors();
+
+      for (size_t k1 = 0; k1 < k; k1 += QR_BLOCKSIZE)
+        {
+          const size_t k2 = std::min(k, k1 + QR_BLOCKSIZE);
+
+          // unblocked Householder QR of the panel
+          for (size_t j = k1; j < k2; j++)
+            {
+              // reflector for A(j:m, j), as LAPACK's dlarfg
+              T alpha = A(j,j);
+              T sigma = 0;
+              for (size_t i = j+1; i < m; i++)
+                sigma += A(i,j)*A(i,j);
+
+              if (sigma == T(0))
+                tau(j) = 0;
+              else
+                {
+                  T beta = -std::copysign(std::sqrt(alpha*alpha+sigma), alpha);
+                  tau(j) = (beta-alpha) / beta;
+                  T scal = 1.0 / (alpha-beta);
+                  for (size_t i = j+1; i < m; i++)
+                    A(i,j) *= scal;
+                  A(j,j) = beta;
+                }
+
+              // apply H_j to the remaining panel columns
+              for (size_t c = j+1; c < k2; c++)
+                {
+                  T w = A(j,c);
+                  for (size_t i = j+1; i < m; i++)
+                    w += A(i,j) * A(i,c);
+                  w *= tau(j);
+                  A(j,c) -= w;
+                  for (size_t i = j+1; i < m; i++)
+                    A(i,c) -= w * A(i,j);
+                }
+            }
+
+          // T factor:  T(0:l,l) = -tau_l T(0:l,0:l) V(:,0:l)^T v_l
+          auto T_ = Ts.cols(k1, k2);
+          for (size_t l = 0; l < k2-k1; l++)
+            {
+              const size_t jl = k1+l;
+              for (size_t p = 0; p < l; p++)
+                {
+                  const size_t jp = k1+p;
+                  T sum = A(jl, jp);        // v_l(jl) = 1
+                  for (size_t i = jl+1; i < m; i++)
+                    sum += A(i,jp) * A(i,jl);
+                  T_(p,l) = -tau(jl) * sum;
+                }
+              for (size_t p = 0; p < l; p++)
+                {
+                  T sum = 0;
+                  for (size_t q = p; q < l; q++)
+                    sum += T_(p,q) * T_(q,l);
+                  T_(p,l) = sum;
+                }
+              T_(l,l) = tau(jl);
+            }
+
+          // trailing columns:  C = (I - V T^T V^T) C
+          if (k2 < n)
+            applyBlockReflector(k1, k2, A.rows(k1, m).cols(k2, n), true);
+        }
+    }
+
+    size_t rows() const { return A.rows(); }
+    size_t cols() const { return A.cols(); }
+
+
+    // b overwritten with Q^T b, b has rows() rows
+    void applyQT (MatrixView<T,ColMajor> b) const
+    {
+      for (size_t k1 = 0; k1 < numReflectors(); k1 += QR_BLOCKSIZE)
+        applyBlockReflector(k1, std::min(numReflectors(), k1+QR_BLOCKSIZE),
+                            b.rows(k1, b.rows()), true);
+    }
+
+    // b overwritten with Q b
+    void applyQ (MatrixView<T,ColMajor> b) const
+    {
+      const size_t k = numReflectors();
+      if (k == 0) return;
+      for (size_t k1 = (k-1) / QR_BLOCKSIZE * QR_BLOCKSIZE; ; k1 -= QR_BLOCKSIZE)
+        {
+          applyBlockReflector(k1, std::min(k, k1+QR_BLOCKSIZE),
+                              b.rows(k1, b.rows()), false);
+          if (k1 == 0) break;
+        }
+    }
+
+    // single vectors are reflected one Householder vector at a time
+    template <typename TDIST>
+    void applyQT (VectorView<T,TDIST> b) const
+    {
+      const size_t m = A.rows();
+      for (size_t j = 0; j < numReflectors(); j++)
+        {
+          T w = b(j);
+          for (size_t i = j+1; i < m; i++)
+            w += A(i,j) * b(i);
+          w *= tau(j);
+          b(j) -= w;
+          for (size_t i = j+1; i < m; i++)
+            b(i) -= w * A(i,j);
+        }
+    }
+
+    template <typename TDIST>
+    void applyQ (VectorView<T,TDIST> b) const
+    {
+      const size_t m = A.rows();
+      for (size_t j = numReflectors(); j-- > 0; )
+        {
+          T w = b(j);
+          for (size_t i = j+1; i < m; i++)
+            w += A(i,j) * b(i);
+          w *= tau(j);
+          b(j) -= w;
+          for (size_t i = j+1; i < m; i++)
+            b(i) -= w * A(i,j);
+        }
+    }
+
+
+    // least squares solution of min |A x - b|, requires rows >= cols
+    template <typename TDIST>
+    Vector<T> solve (VectorView<T,TDIST> b) const
+    {
+      const size_t n = A.cols();
+      if (A.rows() < n)
+        throw std::invalid_argument("QR::solve needs rows >= cols");
+
+      Vector<T> tmp(b.size());
+      tmp = b;
+      applyQT (tmp);
+
+      // R x = (Q^T b)(0:n)
+      Vector<T> x(n);
+      for (size_t j = n; j-- > 0; )
+        {
+          if (A(j,j) == T(0))
+            throw std::runtime_error("QR::solve: matrix rank deficient, R("
+                                     + std::to_string(j) + "," + std::to_string(j) + ") = 0");
+          T sum = tmp(j);
+          for (size_t l = j+1; l < n; l++)
+            sum -= A(j,l) * x(l);
+          x(j) = sum / A(j,j);
+        }
+      return x;
+    }
+
+    // least squares solutions for all columns of b
+    template <ORDERING OB>
+    Matrix<T,ColMajor> solve (MatrixView<T,OB> b) const
+    {
+      const size_t n = A.cols();
+      if (A.rows() < n)
+        throw std::invalid_argument("QR::solve needs rows >= cols");
+
+      Matrix<T,ColMajor> tmp(b.rows(), b.cols());
+      tmp = b;
+      applyQT (tmp);
+
+      Matrix<T,ColMajor> x(n, b.cols());
+      for (size_t c = 0; c < b.cols(); c++)
+        for (size_t j = n; j-- > 0; )
+          {
+            if (A(j,j) == T(0))
+              throw std::runtime_error("QR::solve: matrix rank deficient, R("
+                                       + std::to_string(j) + "," + std::to_string(j) + ") = 0");
+            T sum = tmp(j,c);
+            for (size_t l = j+1; l < n; l++)
+              sum -= A(j,l) * x(l,c);
+            x(j,c) = sum / A(j,j);
+          }
+      return x;
+    }
+
+    // economy size Q:  rows x min(rows,cols), orthonormal columns
+    Matrix<T,ColMajor> Q() const
+    {
+      const size_t k = numReflectors();
+      Matrix<T,ColMajor> q(A.rows(), k);
+      q = T(0);
+      for (size_t i = 0; i < k; i++)
+        q(i,i) = 1;
+      applyQ (q);
+      return q;
+    }
+
+    // upper triangular factor: min(rows,cols) x cols
+    Matrix<T,ColMajor> R() const
+    {
+      Matrix<T,ColMajor> r(numReflectors(), A.cols());
+      for (size_t j = 0; j < r.cols(); j++)
+        for (size_t i = 0; i < r.rows(); i++)
+          r(i,j) = (j >= i) ? A(i,j) : T(0);
+      return r;
+    }
+  };
+
+}
+
+#endif
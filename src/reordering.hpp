@@ -0,0 +1,355 @@
+#ifndef FILE_REORDERING_HPP
+#define FILE_REORDERING_HPP
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+#include "sparse.hpp"
+
+
+namespace nanoblas
+{
+
+  /*
+    Permutation P of {0, ..., n-1}:  (P x)(k) = x(perm[k]),
+    i.e. the new index k refers to the old index perm[k].
+    Applied to vectors and matrices by index mapping, the
+    permutation matrix is never formed.
+  */
+
+  class Permutation
+  {
+    std::vector<size_t> m_perm;   // new -> old
+    std::vector<size_t> m_inv;    // old -> new
+
+  public:
+    // identity
+    explicit Permutation (size_t n) : m_perm(n), m_inv(n)
+    {
+      for (size_t i = 0; i < n; i++)
+        m_perm[i] = m_inv[i] = i;
+    }
+
+    explicit Permutation (std::vector<size_t> perm)
+      : m_perm(std::move(perm)), m_inv(m_perm.size(), SIZE_MAX)
+    {
+      for (size_t k = 0; k < m_perm.size(); k++)
+        {
+          if (m_perm[k] >= m_perm.size() || m_inv[m_perm[k]] != SIZE_MAX)
+            throw std::invalid_argument("Permutation: not a permutation");
+          m_inv[m_perm[k]] = k;
+        }
+    }
+
+    size_t size() const { return m_perm.size(); }
+    size_t operator() (size_t k) const { return m_perm[k]; }     // old index of new index k
+    size_t inverse (size_t i) const { return m_inv[i]; }         // new index of old index i
+    const std::vector<size_t> & indices() const { return m_perm; }
+
+    Permutation inverse () const { return Permutation(m_inv); }
+
+    // y = P x
+    template <typename T, typename TDX, typename TDY>
+    void apply (VectorView<T,TDX> x, VectorView<T,TDY> y) const
+    {
+      assert(x.size() == size() && y.size() == size());
+      for (size_t k = 0; k < size(); k++)
+        y(k) = x(m_perm[k]);
+    }
+
+    // y = P^T x, undoes apply
+    template <typename T, typename TDX, typename TDY>
+    void applyTrans (VectorView<T,TDX> x, VectorView<T,TDY> y) const
+    {
+      assert(x.size() == size() && y.size() == size());
+      for (size_t k = 0; k < size(); k++)
+        y(m_perm[k]) = x(k);
+    }
+
+    // B = P A, rows permuted
+    template <typename T, ORDERING OA, ORDERING OB>
+    void applyRows (MatrixView<T,OA> A, MatrixView<T,OB> B) const
+    {
+      assert(A.rows() == size() && B.rows() == size() && A.cols() == B.cols());
+      for (size_t k = 0; k < size(); k++)
+        B.row(k) = A.row(m_perm[k]);
+    }
+
+    // B = A P^T, columns permuted
+    template <typename T, ORDERING OA, ORDERING OB>
+    void applyCols (MatrixView<T,OA> A, MatrixView<T,OB> B) const
+    {
+      assert(A.cols() == size() && B.cols() == size() && A.rows() == B.rows());
+      for (size_t k = 0; k < size(); k++)
+        B.col(k) = A.col(m_perm[k]);
+    }
+
+    // P A P^T,  B(k,l) = A(perm[k], perm[l])
+    template <typename T>
+    SparseMatrix<T> applySymmetric (const SparseMatrix<T> & A) const
+    {
+      if (A.rows() != size() || A.cols() != size())
+        throw std::invalid_argument("Permutation::applySymmetric: size mismatch");
+
+      const auto & ind = A.colInd();
+      const auto & val = A.values();
+      std::vector<size_t> rowptr(size()+1, 0);
+      for (size_t k = 0; k < size(); k++)
+        rowptr[k+1] = rowptr[k] + A.next(m_perm[k]) - A.first(m_perm[k]);
+
+      std::vector<size_t> colind(A.nnz());
+      std::vector<T> values(A.nnz());
+      std::vector<std::pair<size_t,T>> row;
+      for (size_t k = 0; k < size(); k++)
+        {
+          const size_t i = m_perm[k];
+          row.clear();
+          for (size_t q = A.first(i); q < A.next(i); q++)
+            row.emplace_back(m_inv[ind[q]], val[q]);
+          std::sort (row.begin(), row.end(),
+                     [](const auto & a, const auto & b) { return a.first < b.first; });
+          for (size_t q = 0; q < row.size(); q++)
+            {
+              colind[rowptr[k]+q] = row[q].first;
+              values[rowptr[k]+q] = row[q].second;
+            }
+        }
+      return SparseMatrix<T>(size(), size(), std::move(rowptr), std::move(colind), std::move(values));
+    }
+  };
+
+
+  // max |i-j| over the non-zeros A(i,j)
+  template <typename T>
+  size_t Bandwidth (const SparseMatrix<T> & A)
+  {
+    size_t bw = 0;
+    const auto & ind = A.colInd();
+    for (size_t i = 0; i < A.rows(); i++)
+      for (size_t k = A.first(i); k < A.next(i); k++)
+        bw = std::max(bw, (ind[k] > i) ? ind[k]-i : i-ind[k]);
+    return bw;
+  }
+
+
+  /*
+    Graph of the pattern of A + A^T without the diagonal, with
+    breadth first level structures restricted to a subset of the
+    vertices (label). Used by the reorderings below.
+  */
+  class MatrixGraph
+  {
+    std::vector<size_t> m_ptr, m_adj;
+    std::vector<size_t> m_label;
+    std::vector<size_t> m_stamp;
+    size_t m_curstamp = 0;
+
+  public:
+    template <typename T>
+    explicit MatrixGraph (const SparseMatrix<T> & A)
+      : m_ptr(A.rows()+1, 0), m_label(A.rows(), 0), m_stamp(A.rows(), 0)
+    {
+      if (A.rows() != A.cols())
+        throw std::invalid_argument("MatrixGraph: matrix must be square");
+
+      const size_t n = A.rows();
+      const auto & ind = A.colInd();
+      std::vector<std::vector<size_t>> nb(n);
+      for (size_t i = 0; i < n; i++)
+        for (size_t k = A.first(i); k < A.next(i); k++)
+          if (ind[k] != i)
+            {
+              nb[i].push_back(ind[k]);
+              nb[ind[k]].push_back(i);
+            }
+      for (size_t i = 0; i < n; i++)
+        {
+          std::sort (nb[i].begin(), nb[i].end());
+          nb[i].erase (std::unique(nb[i].begin(), nb[i].end()), nb[i].end());
+          m_ptr[i+1] = m_ptr[i] + nb[i].size();
+        }
+      m_adj.reserve(m_ptr[n]);
+      for (auto & list : nb)
+        m_adj.insert(m_adj.end(), list.begin(), list.end());
+    }
+
+    size_t size() const { return m_label.size(); }
+    size_t degree (size_t i) const { return m_ptr[i+1]-m_ptr[i]; }
+    const size_t * neighbours (size_t i) const { return m_adj.data()+m_ptr[i]; }
+
+    size_t label (size_t i) const { return m_label[i]; }
+    void setLabel (size_t i, size_t label) { m_label[i] = label; }
+
+    /*
+      Level structure from root within the vertices of the same label,
+      levels[l] are the vertices at distance l. With byDegree, the new
+      neighbours of a vertex are appended by increasing degree
+      (Cuthill-McKee order).
+    */
+    std::vector<std::vector<size_t>> levels (size_t root, bool byDegree = false)
+    {
+      const size_t label = m_label[root];
+      m_curstamp++;
+      std::vector<std::vector<size_t>> lev { { root } };
+      m_stamp[root] = m_curstamp;
+      while (true)
+        {
+          std::vector<size_t> next;
+          for (size_t v : lev.back())
+            {
+              const size_t first = next.size();
+              for (size_t q = m_ptr[v]; q < m_ptr[v+1]; q++)
+                {
+                  size_t w = m_adj[q];
+                  if (m_label[w] == label && m_stamp[w] != m_curstamp)
+                    {
+                      m_stamp[w] = m_curstamp;
+                      next.push_back(w);
+                    }
+                }
+              if (byDegree)
+                std::sort (next.begin()+first, next.end(),
+                           [this](size_t a, size_t b) { return degree(a) < degree(b); });
+            }
+          if (next.empty()) break;
+          lev.push_back(std::move(next));
+        }
+      return lev;
+    }
+
+    // vertex with (nearly) maximal eccentricity in the component of start (George-Liu)
+    size_t pseudoPeripheral (size_t start)
+    {
+      size_t root = start;
+      size_t depth = levels(root).size();
+      while (true)
+        {
+          auto lev = levels(root);
+          size_t cand = *std::min_element(lev.back().begin(), lev.back().end(),
+                                          [this](size_t a, size_t b) { return degree(a) < degree(b); });
+          size_t cdepth = levels(cand).size();
+          if (cdepth <= depth) return root;
+          root = cand;
+          depth = cdepth;
+        }
+    }
+  };
+
+
+  /*
+    Reverse Cuthill-McKee ordering of the pattern of A + A^T:
+    breadth first search from a pseudo-peripheral vertex of every
+    connected component, neighbours by increasing degree, reversed.
+    Reduces the bandwidth and profile; the permuted matrix is
+    Permutation::applySymmetric(A).
+  */
+  template <typename T>
+  Permutation ReverseCuthillMcKee (const SparseMatrix<T> & A)
+  {
+    MatrixGraph graph(A);
+    const size_t n = graph.size();
+    std::vector<size_t> order;
+    order.reserve(n);
+    std::vector<bool> done(n, false);
+
+    // components started at a vertex of small degree
+    std::vector<size_t> byDegree(n);
+    for (size_t i = 0; i < n; i++) byDegree[i] = i;
+    std::stable_sort (byDegree.begin(), byDegree.end(),
+                      [&graph](size_t a, size_t b) { return graph.degree(a) < graph.degree(b); });
+
+    for (size_t start : byDegree)
+      {
+        if (done[start]) continue;
+        size_t root = graph.pseudoPeripheral(start);
+        for (auto & level : graph.levels(root, true))
+          for (size_t v : level)
+            {
+              done[v] = true;
+              order.push_back(v);
+            }
+      }
+
+    std::reverse (order.begin(), order.end());
+    return Permutation(std::move(order));
+  }
+
+
+  /*
+    Nested dissection ordering of the pattern of A + A^T:
+    the middle level of a level structure from a pseudo-peripheral
+    vertex separates the vertex set into two parts, which are ordered
+    recursively first, the separator is numbered last. Parts with at
+    most min_size vertices (or without a separating level) are
+    ordered breadth first, disconnected parts one component after the
+    other. Reduces the fill-in of direct factorizations and keeps the
+    parts contiguous in memory.
+  */
+  template <typename T>
+  Permutation NestedDissection (const SparseMatrix<T> & A, size_t min_size = 64)
+  {
+    MatrixGraph graph(A);
+    const size_t n = graph.size();
+    std::vector<size_t> order(n);
+    size_t num_labels = 0;
+
+    // order the vertices 'nodes' into order[first, first+nodes.size())
+    auto dissect = [&](auto && self, const std::vector<size_t> & nodes, size_t first) -> void
+    {
+      const size_t label = ++num_labels;
+      for (size_t v : nodes) graph.setLabel(v, label);
+
+      // one connected component after the other: the vertices of a
+      // finished component are relabelled, so the scan skips them
+      for (size_t v0 : nodes)
+        {
+          if (graph.label(v0) != label) continue;
+
+          auto lev = graph.levels(graph.pseudoPeripheral(v0));
+          const size_t done = ++num_labels;
+          size_t size = 0;
+          for (auto & level : lev)
+            for (size_t v : level)
+              {
+                graph.setLabel(v, done);
+                size++;
+              }
+
+          if (size <= min_size || lev.size() < 3)
+            {
+              size_t pos = first;
+              for (auto & level : lev)
+                for (size_t v : level) order[pos++] = v;
+            }
+          else
+            {
+              std::vector<size_t> part1, part2, sep;
+              const size_t mid = lev.size()/2;
+              for (size_t l = 0; l < lev.size(); l++)
+                {
+                  auto & dest = (l < mid) ? part1 : (l == mid) ? sep : part2;
+                  dest.insert(dest.end(), lev[l].begin(), lev[l].end());
+                }
+              lev.clear();
+
+              const size_t size1 = part1.size(), size2 = part2.size();
+              for (size_t l = 0; l < sep.size(); l++)
+                order[first+size1+size2+l] = sep[l];
+              self (self, part1, first);
+              self (self, part2, first+size1);
+            }
+          first += size;
+        }
+    };
+
+    std::vector<size_t> all(n);
+    for (size_t i = 0; i < n; i++) all[i] = i;
+    dissect (dissect, all, 0);
+    return Permutation(std::move(order));
+  }
+
+}
+
+#endif
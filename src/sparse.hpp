@@ -0,0 +1,380 @@
+#ifndef FILE_SPARSE_HPP
+#define FILE_SPARSE_HPP
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <array>
+#include <memory>
+#include <thread>
+
+#include "vector.hpp"
+#include "matrix.hpp"
+
+
+namespace nanoblas
+{
+
+  /*
+    Sparse matrix in compressed row storage (CSR):
+
+      the entries of row i are  values[k], column colind[k],
+      for k in [rowptr[i], rowptr[i+1]),  columns sorted ascending.
+  */
+
+  template <typename T = double>
+  class SparseMatrix
+  {
+    size_t m_rows, m_cols;
+    std::vector<size_t> m_rowptr;
+    std::vector<size_t> m_colind;
+    std::vector<T> m_values;
+
+  public:
+    SparseMatrix (size_t rows, size_t cols)
+      : m_rows(rows), m_cols(cols), m_rowptr(rows+1, 0) { }
+
+    SparseMatrix (size_t rows, size_t cols, std::vector<size_t> rowptr,
+                  std::vector<size_t> colind, std::vector<T> values)
+      : m_rows(rows), m_cols(cols), m_rowptr(std::move(rowptr)),
+        m_colind(std::move(colind)), m_values(std::move(values))
+    {
+      if (m_rowptr.size() != rows+1 || m_colind.size() != m_rowptr.back()
+          || m_values.size() != m_colind.size())
+        throw std::invalid_argument("SparseMatrix: inconsistent CSR arrays");
+    }
+
+    // the non-zero entries of a dense matrix
+    template <ORDERING ORD>
+    explicit SparseMatrix (MatrixView<T,ORD> A)
+      : m_rows(A.rows()), m_cols(A.cols()), m_rowptr(A.rows()+1, 0)
+    {
+      for (size_t i = 0; i < m_rows; i++)
+        {
+          for (size_t j = 0; j < m_cols; j++)
+            if (A(i,j) != T(0))
+              {
+                m_colind.push_back(j);
+                m_values.push_back(A(i,j));
+              }
+          m_rowptr[i+1] = m_colind.size();
+        }
+    }
+
+    size_t rows() const { return m_rows; }
+    size_t cols() const { return m_cols; }
+    size_t nnz() const { return m_colind.size(); }
+
+    const std::vector<size_t> & rowPtr() const { return m_rowptr; }
+    const std::vector<size_t> & colInd() const { return m_colind; }
+    const std::vector<T> & values() const { return m_values; }
+    std::vector<T> & values() { return m_values; }
+
+    // entries of row i: [first(i), next(i))
+    size_t first (size_t i) const { return m_rowptr[i]; }
+    size_t next (size_t i) const { return m_rowptr[i+1]; }
+
+    // A(i,j), 0 if not in the pattern
+    T operator() (size_t i, size_t j) const
+    {
+      auto begin = m_colind.begin()+m_rowptr[i];
+      auto end = m_colind.begin()+m_rowptr[i+1];
+      auto pos = std::lower_bound(begin, end, j);
+      if (pos == end || *pos != j) return T(0);
+      return m_values[pos - m_colind.begin()];
+    }
+
+    // dot product of row i with x
+    template <typename TV>
+    T rowDot (size_t i, const TV & x) const
+    {
+      const size_t k1 = m_rowptr[i], k2 = m_rowptr[i+1];
+      const size_t * ind = m_colind.data();
+      const T * val = m_values.data();
+
+      // four independent partial sums
+      T s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+      size_t k = k1;
+      for ( ; k+4 <= k2; k += 4)
+        {
+          s0 += val[k]   * x(ind[k]);
+          s1 += val[k+1] * x(ind[k+1]);
+          s2 += val[k+2] * x(ind[k+2]);
+          s3 += val[k+3] * x(ind[k+3]);
+        }
+      for ( ; k < k2; k++)
+        s0 += val[k] * x(ind[k]);
+      return (s0+s1) + (s2+s3);
+    }
+
+    // row partition [part[t], part[t+1]) with about nnz/num_parts entries each
+    std::vector<size_t> balancedPartition (size_t num_parts) const
+    {
+      std::vector<size_t> part(num_parts+1);
+      part[0] = 0;
+      for (size_t t = 1; t < num_parts; t++)
+        {
+          size_t target = t * nnz() / num_parts;
+          part[t] = std::lower_bound(m_rowptr.begin(), m_rowptr.end(), target) - m_rowptr.begin();
+          part[t] = std::max(part[t-1], std::min(part[t], m_rows));
+        }
+      part[num_parts] = m_rows;
+      return part;
+    }
+
+    SparseMatrix transpose () const
+    {
+      std::vector<size_t> rowptr(m_cols+1, 0);
+      for (size_t k = 0; k < nnz(); k++)
+        rowptr[m_colind[k]+1]++;
+      for (size_t j = 0; j < m_cols; j++)
+        rowptr[j+1] += rowptr[j];
+
+      std::vector<size_t> colind(nnz());
+      std::vector<T> values(nnz());
+      std::vector<size_t> pos(rowptr.begin(), rowptr.end()-1);
+      for (size_t i = 0; i < m_rows; i++)
+        for (size_t k = m_rowptr[i]; k < m_rowptr[i+1]; k++)
+          {
+            size_t p = pos[m_colind[k]]++;
+            colind[p] = i;
+            values[p] = m_values[k];
+          }
+      return SparseMatrix(m_cols, m_rows, std::move(rowptr), std::move(colind), std::move(values));
+    }
+
+    Matrix<T> toDense () const
+    {
+      Matrix<T> A(m_rows, m_cols);
+      A = T(0);
+      for (size_t i = 0; i < m_rows; i++)
+        for (size_t k = m_rowptr[i]; k < m_rowptr[i+1]; k++)
+          A(i, m_colind[k]) = m_values[k];
+      return A;
+    }
+  };
+
+
+  // number of non-zeros handled by one task
+  constexpr size_t SPARSE_GRAIN = 16384;
+
+
+  // exclusive prefix sum of v[0..n) into v[0..n], v.size() == n+1, in two parallel passes
+  inline void ParallelPrefixSum (std::vector<size_t> & v)
+  {
+    const size_t n = v.size()-1;
+    const size_t num_tasks = std::max<size_t>(1, n / SPARSE_GRAIN);
+    std::vector<size_t> blocksum(num_tasks+1, 0);
+
+    auto range = [n,num_tasks](size_t t) { return std::array<size_t,2>{ t*n/num_tasks, (t+1)*n/num_tasks }; };
+
+    ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+    {
+      auto [i1, i2] = range(t);
+      size_t sum = 0;
+      for (size_t i = i1; i < i2; i++)
+        sum += v[i];
+      blocksum[t+1] = sum;
+    });
+
+    for (size_t t = 0; t < num_tasks; t++)
+      blocksum[t+1] += blocksum[t];
+
+    ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+    {
+      auto [i1, i2] = range(t);
+      size_t sum = blocksum[t];
+      for (size_t i = i1; i < i2; i++)
+        {
+          size_t vi = v[i];
+          v[i] = sum;
+          sum += vi;
+        }
+    });
+    v[n] = blocksum[num_tasks];
+  }
+
+
+  // ************************* sparse matrix - vector product *******************
+
+  template <typename T, typename TV>
+  class MultSparseMatVecExpr : public VecExpr<MultSparseMatVecExpr<T,TV>>
+  {
+    const SparseMatrix<T> & a;
+    TV x;
+  public:
+    MultSparseMatVecExpr (const SparseMatrix<T> & _a, TV _x) : a(_a), x(_x) { }
+    size_t size() const { return a.rows(); }
+    auto operator() (size_t i) const { return a.rowDot(i, x); }
+  };
+
+  template <typename T, typename TV>
+  auto operator* (const SparseMatrix<T> & a, const VecExpr<TV> & x)
+  {
+    assert(a.cols() == x.size());
+    return MultSparseMatVecExpr<T,TV>(a, x.derived());
+  }
+
+  // y = A x, row partitions balanced by their number of non-zeros
+  template <typename T, typename TDX, typename TDY>
+  void MultSparseMatVec_parallel (const SparseMatrix<T> & a,
+                                  VectorView<T,TDX> x, VectorView<T,TDY> y)
+  {
+    assert(a.cols() == x.size() && a.rows() == y.size());
+    const size_t num_tasks = std::max<size_t>(1, a.nnz() / SPARSE_GRAIN);
+    auto part = a.balancedPartition(num_tasks);
+
+    ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+    {
+      for (size_t i = part[t]; i < part[t+1]; i++)
+        y(i) = a.rowDot(i, x);
+    });
+  }
+
+
+  // ************************* sparse matrix - dense matrix product *******************
+
+  // Y(i, j0..j0+W) = A(i,:) X(:, j0..j0+W)
+  template <size_t W, typename T, ORDERING OX, ORDERING OY>
+  inline void SparseRowMultMulti (const SparseMatrix<T> & a, size_t i,
+                                  MatrixView<T,OX> X, MatrixView<T,OY> Y, size_t j0)
+  {
+    const size_t * ind = a.colInd().data();
+    const T * val = a.values().data();
+    T acc[W] = { };
+    for (size_t k = a.first(i); k < a.next(i); k++)
+      {
+        T v = val[k];
+        for (size_t w = 0; w < W; w++)
+          acc[w] += v * X(ind[k], j0+w);
+      }
+    for (size_t w = 0; w < W; w++)
+      Y(i, j0+w) = acc[w];
+  }
+
+  /*
+    Y(rows [i1, i2), :) = A X.
+    Every row of A is read from memory once and applied to all columns
+    of X, in groups of 8 (then 4, then 1) right hand sides kept in
+    registers. With RowMajor X and Y the group loads and stores are
+    contiguous and vectorize.
+  */
+  template <typename T, ORDERING OX, ORDERING OY>
+  void MultSparseMatMatRows (const SparseMatrix<T> & a,
+                             MatrixView<T,OX> X, MatrixView<T,OY> Y,
+                             size_t i1, size_t i2)
+  {
+    const size_t ncols = X.cols();
+    for (size_t i = i1; i < i2; i++)
+      {
+        size_t j0 = 0;
+        for ( ; j0+8 <= ncols; j0 += 8)
+          SparseRowMultMulti<8> (a, i, X, Y, j0);
+        for ( ; j0+4 <= ncols; j0 += 4)
+          SparseRowMultMulti<4> (a, i, X, Y, j0);
+        for ( ; j0 < ncols; j0++)
+          SparseRowMultMulti<1> (a, i, X, Y, j0);
+      }
+  }
+
+  // Y = A X
+  template <typename T, ORDERING OX, ORDERING OY>
+  void MultSparseMatMat (const SparseMatrix<T> & a,
+                         MatrixView<T,OX> X, MatrixView<T,OY> Y)
+  {
+    assert(a.cols() == X.rows() && a.rows() == Y.rows() && X.cols() == Y.cols());
+    MultSparseMatMatRows (a, X, Y, 0, a.rows());
+  }
+
+  // Y = A X, row partitions balanced by their number of non-zeros
+  template <typename T, ORDERING OX, ORDERING OY>
+  void MultSparseMatMat_parallel (const SparseMatrix<T> & a,
+                                  MatrixView<T,OX> X, MatrixView<T,OY> Y)
+  {
+    assert(a.cols() == X.rows() && a.rows() == Y.rows() && X.cols() == Y.cols());
+    const size_t work = a.nnz() * std::max<size_t>(1, X.cols());
+    const size_t num_tasks = std::max<size_t>(1, std::min(work / SPARSE_GRAIN, a.rows()));
+    auto part = a.balancedPartition(num_tasks);
+
+    ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+    {
+      MultSparseMatMatRows (a, X, Y, part[t], part[t+1]);
+    });
+  }
+
+
+  // y = A^T x
+  template <typename T, typename TDX, typename TDY>
+  void MultTransSparseMatVec (const SparseMatrix<T> & a,
+                              VectorView<T,TDX> x, VectorView<T,TDY> y)
+  {
+    assert(a.rows() == x.size() && a.cols() == y.size());
+    y = T(0);
+    const auto & ind = a.colInd();
+    const auto & val = a.values();
+    for (size_t i = 0; i < a.rows(); i++)
+      {
+        T xi = x(i);
+        for (size_t k = a.first(i); k < a.next(i); k++)
+          y(ind[k]) += val[k] * xi;
+      }
+  }
+
+  /*
+    y = A^T x, parallel: every task scatters its row partition into
+    a private buffer, the buffers are summed up column-wise afterwards.
+    There are at most as many buffers as workers and together they
+    hold at most nnz/4 values, with fewer non-zeros per column the
+    serial kernel is faster and used instead. For repeated products with A^T, a.transpose() and
+    MultSparseMatVec_parallel is faster.
+  */
+  template <typename T, typename TDX, typename TDY>
+  void MultTransSparseMatVec_parallel (const SparseMatrix<T> & a,
+                                       VectorView<T,TDX> x, VectorView<T,TDY> y)
+  {
+    assert(a.rows() == x.size() && a.cols() == y.size());
+    const size_t n = a.cols();
+    const size_t workers = std::max<unsigned>(1, std::thread::hardware_concurrency());
+    const size_t num_tasks = std::min({ a.nnz() / SPARSE_GRAIN, a.nnz() / (4*std::max<size_t>(1, n)),
+                                        workers, size_t(64) });
+    if (num_tasks <= 1)
+      {
+        MultTransSparseMatVec (a, x, y);
+        return;
+      }
+
+    auto part = a.balancedPartition(num_tasks);
+    auto buffer = std::make_unique_for_overwrite<T[]>(num_tasks*n);   // zeroed by the tasks
+    const auto & ind = a.colInd();
+    const auto & val = a.values();
+
+    ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+    {
+      T * yt = buffer.get() + t*n;
+      std::fill (yt, yt+n, T(0));
+      for (size_t i = part[t]; i < part[t+1]; i++)
+        {
+          T xi = x(i);
+          for (size_t k = a.first(i); k < a.next(i); k++)
+            yt[ind[k]] += val[k] * xi;
+        }
+    });
+
+    const size_t num_sum = (n + SPARSE_GRAIN - 1) / SPARSE_GRAIN;
+    ASC_HPC::RunParallel(static_cast<int>(num_sum), [&](int t, int /*ntasks*/)
+    {
+      const size_t j1 = static_cast<size_t>(t) * SPARSE_GRAIN;
+      const size_t j2 = std::min(n, j1 + SPARSE_GRAIN);
+      for (size_t j = j1; j < j2; j++)
+        {
+          T sum = 0;
+          for (size_t s = 0; s < num_tasks; s++)
+            sum += buffer[s*n+j];
+          y(j) = sum;
+        }
+    });
+  }
+
+}
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef FILE_SPARSE_ASSEMBLY_HPP
+#define FILE_SPARSE_ASSEMBLY_HPP
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "sparse.hpp"
+
+
+namespace nanoblas
+{
+
+  /*
+    Builds a CSR matrix from (row, col, value) triplets, duplicates
+    are summed up.
+
+    build() runs in parallel:
+      1. count the triplets per row           (atomic counters)
+      2. prefix scan                          -> row offsets
+      3. scatter the triplet numbers by row   (atomic slots)
+      4. sort every row by (col, triplet number) and merge duplicates
+      5. prefix scan of the merged row lengths, fill the CSR arrays
+
+    The sorted triplet order is kept. After beginReassembly(), the
+    same sequence of add() calls (same rows and columns, new values)
+    followed by reassemble(A) only recomputes A.values(): every
+    non-zero sums its own triplets, so no atomics are needed and the
+    result does not depend on the thread schedule. The values of a
+    reassembly can also be written concurrently through value(k).
+    An add() after build() outside of a reassembly appends a new
+    triplet and drops the pattern analysis, the next build() redoes it.
+  */
+
+  template <typename T = double>
+  class SparseAssembler
+  {
+    size_t m_rows, m_cols;
+    std::vector<size_t> m_i, m_j;
+    std::vector<T> m_v;
+
+    // pattern analysis of the last build()
+    bool m_analyzed = false;
+    bool m_reassembling = false;       // between beginReassembly() and reassemble()
+    size_t m_count = 0;                // add() position during reassembly
+    std::vector<size_t> m_order;       // triplet numbers, sorted by (row, col)
+    std::vector<size_t> m_contrib;     // triplets of non-zero p: m_order[m_contrib[p] .. m_contrib[p+1])
+
+  public:
+    SparseAssembler (size_t rows, size_t cols)
+      : m_rows(rows), m_cols(cols) { }
+
+    size_t numTriplets() const { return m_v.size(); }
+
+    void reserve (size_t n)
+    {
+      m_i.reserve(n);
+      m_j.reserve(n);
+      m_v.reserve(n);
+    }
+
+    void add (size_t i, size_t j, T v)
+    {
+      if (i >= m_rows || j >= m_cols)
+        throw std::out_of_range("SparseAssembler::add: index out of range");
+      if (m_reassembling)
+        {
+          if (m_count >= m_v.size() || m_i[m_count] != i || m_j[m_count] != j)
+            throw std::logic_error("SparseAssembler::add: reassembly does not match the triplet sequence");
+          m_v[m_count++] = v;
+          return;
+        }
+      if (m_analyzed)
+        {
+          m_analyzed = false;
+          m_order.clear();
+          m_contrib.clear();
+        }
+      m_i.push_back(i);
+      m_j.push_back(j);
+      m_v.push_back(v);
+    }
+
+    // element matrix: A(rowdofs[r], coldofs[c]) += elmat(r,c)
+    template <ORDERING ORD>
+    void add (const std::vector<size_t> & rowdofs, const std::vector<size_t> & coldofs,
+              MatrixView<T,ORD> elmat)
+    {
+      for (size_t r = 0; r < rowdofs.size(); r++)
+        for (size_t c = 0; c < coldofs.size(); c++)
+          add (rowdofs[r], coldofs[c], elmat(r,c));
+    }
+
+    // value of triplet k, for filling a reassembly in parallel
+    T & value (size_t k) { return m_v[k]; }
+
+
+    SparseMatrix<T> build ()
+    {
+      const size_t nt = m_v.size();
+      const size_t num_tasks = std::max<size_t>(1, nt / SPARSE_GRAIN);
+      auto chunk = [nt,num_tasks](size_t t) { return std::array<size_t,2>{ t*nt/num_tasks, (t+1)*nt/num_tasks }; };
+
+      // 1. count
+      std::vector<std::atomic<size_t>> slot(m_rows);
+      for (auto & s : slot) s.store(0, std::memory_order_relaxed);
+      ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+      {
+        auto [k1, k2] = chunk(t);
+        for (size_t k = k1; k < k2; k++)
+          slot[m_i[k]].fetch_add(1, std::memory_order_relaxed);
+      });
+
+      // 2. scan
+      std::vector<size_t> start(m_rows+1);
+      for (size_t i = 0; i < m_rows; i++)
+        start[i] = slot[i].load(std::memory_order_relaxed);
+      ParallelPrefixSum (start);
+
+      // 3. scatter
+      for (size_t i = 0; i < m_rows; i++)
+        slot[i].store(start[i], std::memory_order_relaxed);
+      m_order.resize(nt);
+      ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+      {
+        auto [k1, k2] = chunk(t);
+        for (size_t k = k1; k < k2; k++)
+          m_order[slot[m_i[k]].fetch_add(1, std::memory_order_relaxed)] = k;
+      });
+
+      // 4. sort and merge rows
+      std::vector<size_t> rowptr(m_rows+1);
+      const size_t num_row_tasks = std::max<size_t>(1, m_rows / 1024);
+      auto rowchunk = [this,num_row_tasks](size_t t)
+        { return std::array<size_t,2>{ t*m_rows/num_row_tasks, (t+1)*m_rows/num_row_tasks }; };
+
+      ASC_HPC::RunParallel(static_cast<int>(num_row_tasks), [&](int t, int /*ntasks*/)
+      {
+        auto [i1, i2] = rowchunk(t);
+        for (size_t i = i1; i < i2; i++)
+          {
+            auto first = m_order.begin()+start[i];
+            auto next = m_order.begin()+start[i+1];
+            std::sort (first, next, [this](size_t a, size_t b)
+                       { return (m_j[a] < m_j[b]) || (m_j[a] == m_j[b] && a < b); });
+            size_t cnt = 0;
+            for (auto it = first; it != next; ++it)
+              if (it == first || m_j[*it] != m_j[*(it-1)])
+                cnt++;
+            rowptr[i] = cnt;
+          }
+      });
+
+      // 5. scan and fill
+      ParallelPrefixSum (rowptr);
+      const size_t nnz = rowptr[m_rows];
+      std::vector<size_t> colind(nnz);
+      m_contrib.resize(nnz+1);
+      m_contrib[nnz] = nt;
+
+      ASC_HPC::RunParallel(static_cast<int>(num_row_tasks), [&](int t, int /*ntasks*/)
+      {
+        auto [i1, i2] = rowchunk(t);
+        for (size_t i = i1; i < i2; i++)
+          {
+            size_t p = rowptr[i];
+            for (size_t q = start[i]; q < start[i+1]; q++)
+              if (q == start[i] || m_j[m_order[q]] != m_j[m_order[q-1]])
+                {
+                  colind[p] = m_j[m_order[q]];
+                  m_contrib[p] = q;
+                  p++;
+                }
+          }
+      });
+
+      m_analyzed = true;
+      m_reassembling = false;
+
+      SparseMatrix<T> A(m_rows, m_cols, std::move(rowptr), std::move(colind), std::vector<T>(nnz));
+      sumValues (A);
+      return A;
+    }
+
+
+    // next add() calls overwrite the values of the triplets in their original order
+    void beginReassembly ()
+    {
+      if (!m_analyzed)
+        throw std::logic_error("SparseAssembler: build() must be called before reassembly");
+      m_reassembling = true;
+      m_count = 0;
+    }
+
+    // A has the pattern of the last build(): the first triplet summed
+    // into non-zero p of row i is at (i, colind[p]), O(nnz) in parallel
+    bool matchesPattern (const SparseMatrix<T> & A) const
+    {
+      if (!m_analyzed || A.rows() != m_rows || A.cols() != m_cols
+          || A.nnz()+1 != m_contrib.size())
+        return false;
+
+      const auto & rowptr = A.rowPtr();
+      const auto & colind = A.colInd();
+      const size_t num_tasks = std::max<size_t>(1, A.nnz() / SPARSE_GRAIN);
+      std::vector<char> ok(num_tasks, true);
+      ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+      {
+        const size_t i1 = t*m_rows/num_tasks, i2 = (t+1)*m_rows/num_tasks;
+        for (size_t i = i1; i < i2; i++)
+          for (size_t p = rowptr[i]; p < rowptr[i+1]; p++)
+            {
+              const size_t k = m_order[m_contrib[p]];
+              if (m_i[k] != i || m_j[k] != colind[p])
+                {
+                  ok[t] = false;
+                  return;
+                }
+            }
+      });
+      return std::all_of (ok.begin(), ok.end(), [](char c) { return c; });
+    }
+
+    // A.values() recomputed from the current triplet values, A must have the pattern of build();
+    // a reassembly through add() must have repeated all triplets
+    void reassemble (SparseMatrix<T> & A)
+    {
+      if (!matchesPattern (A))
+        throw std::logic_error("SparseAssembler::reassemble: pattern does not match");
+      if (m_reassembling && m_count != 0 && m_count != m_v.size())
+        throw std::logic_error("SparseAssembler::reassemble: only "+std::to_string(m_count)+" of "
+                               +std::to_string(m_v.size())+" triplets were added");
+      m_reassembling = false;
+      sumValues (A);
+    }
+
+  private:
+    // values[p] = sum of the triplets of non-zero p
+    void sumValues (SparseMatrix<T> & A) const
+    {
+      auto & values = A.values();
+      const size_t nnz = A.nnz();
+      const size_t num_tasks = std::max<size_t>(1, nnz / SPARSE_GRAIN);
+      ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+      {
+        const size_t p1 = t*nnz/num_tasks, p2 = (t+1)*nnz/num_tasks;
+        for (size_t p = p1; p < p2; p++)
+          {
+            T sum = 0;
+            for (size_t q = m_contrib[p]; q < m_contrib[p+1]; q++)
+              sum += m_v[m_order[q]];
+            values[p] = sum;
+          }
+      });
+    }
+  };
+
+}
+
+#endif
@@ -0,0 +1,309 @@
+#ifndef FILE_SPGEMM_HPP
+#define FILE_SPGEMM_HPP
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+#include "sparse.hpp"
+
+
+namespace nanoblas
+{
+
+  /*
+    Sparse matrix - sparse matrix product C = A B in two phases:
+
+      symbolic (constructor): the pattern of C. Rows are distributed
+        over the workers balanced by their number of products
+        flops(i) = sum_{k in A(i,:)} nnz(B(k,:)), every task merges the
+        column indices of its rows and keeps them in a private buffer,
+        after the prefix sum of the row lengths the buffers are copied
+        into the CSR arrays of C.
+
+      numeric (multiply): the values of C. Can be called again when only
+        the values of A and B have changed, the pattern and the row
+        partition are reused. The patterns of A and B are compared
+        with the symbolic product by a hash, a changed pattern throws.
+
+    Rows are merged with a dense accumulator (array of length B.cols())
+    when flops(i) >= B.cols()/DENSE_FRACTION, otherwise with a hash
+    table of size 2^p >= 2 flops(i), which stays in cache for the
+    short rows typical for AMG prolongations.
+  */
+
+  template <typename T = double>
+  class SparseProduct
+  {
+    static constexpr size_t DENSE_FRACTION = 8;
+    static constexpr size_t EMPTY = SIZE_MAX;
+
+    size_t m_rows, m_cols, m_inner;
+    size_t m_annz, m_bnnz;
+    uint64_t m_ahash, m_bhash;        // patternHash of A and B
+    std::vector<size_t> m_rowptr, m_colind;
+    std::vector<size_t> m_flops;      // flops[i] = products in row i
+    std::vector<size_t> m_part;       // row partition of the tasks
+
+    bool useDense (size_t i) const { return m_flops[i]*DENSE_FRACTION >= m_cols; }
+
+    static size_t hashSize (size_t flops)
+    {
+      size_t size = 16;
+      while (size < 2*flops) size *= 2;
+      return size;
+    }
+
+    static size_t hash (size_t col, size_t mask) { return (col * 0x9E3779B97F4A7C15ull >> 16) & mask; }
+
+    // f(j, a_ik*b_kj) for all products of row i
+    template <typename FUNC>
+    static void forRowProducts (const SparseMatrix<T> & a, const SparseMatrix<T> & b,
+                                size_t i, FUNC && f)
+    {
+      const auto & aind = a.colInd();
+      const auto & aval = a.values();
+      const auto & bind = b.colInd();
+      const auto & bval = b.values();
+      for (size_t ka = a.first(i); ka < a.next(i); ka++)
+        {
+          const size_t k = aind[ka];
+          const T aik = aval[ka];
+          for (size_t kb = b.first(k); kb < b.next(k); kb++)
+            f(bind[kb], aik*bval[kb]);
+        }
+    }
+
+    static uint64_t mix (uint64_t x)
+    {
+      x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+      x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+      return x ^ (x >> 31);
+    }
+
+    // sum of a hash of (i,j) over the non-zeros, independent of the
+    // summation order and therefore computed in parallel
+    static uint64_t patternHash (const SparseMatrix<T> & a)
+    {
+      const size_t num_tasks = std::max<size_t>(1, a.nnz() / SPARSE_GRAIN);
+      auto part = a.balancedPartition(num_tasks);
+      std::vector<uint64_t> sums(num_tasks, 0);
+      const auto & ind = a.colInd();
+      ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+      {
+        uint64_t sum = 0;
+        for (size_t i = part[t]; i < part[t+1]; i++)
+          {
+            const uint64_t hi = mix(i);
+            for (size_t k = a.first(i); k < a.next(i); k++)
+              sum += mix(hi ^ ind[k]);
+          }
+        sums[t] = sum;
+      });
+      uint64_t hash = 0;
+      for (uint64_t s : sums) hash += s;
+      return hash;
+    }
+
+    void checkShapes (const SparseMatrix<T> & a, const SparseMatrix<T> & b) const
+    {
+      if (a.rows() != m_rows || a.cols() != m_inner || b.rows() != m_inner || b.cols() != m_cols
+          || a.nnz() != m_annz || b.nnz() != m_bnnz
+          || patternHash(a) != m_ahash || patternHash(b) != m_bhash)
+        throw std::invalid_argument("SparseProduct: matrices do not match the symbolic product");
+    }
+
+  public:
+    SparseProduct (const SparseMatrix<T> & a, const SparseMatrix<T> & b)
+      : m_rows(a.rows()), m_cols(b.cols()), m_inner(a.cols()),
+        m_annz(a.nnz()), m_bnnz(b.nnz()), m_rowptr(a.rows()+1), m_flops(a.rows()+1)
+    {
+      if (a.cols() != b.rows())
+        throw std::invalid_argument("SparseProduct: A.cols() != B.rows()");
+      m_ahash = patternHash(a);
+      m_bhash = patternHash(b);
+
+      // products per row, prefix sum for the partition
+      const size_t num_row_tasks = std::max<size_t>(1, m_rows / 4096);
+      ASC_HPC::RunParallel(static_cast<int>(num_row_tasks), [&](int t, int /*ntasks*/)
+      {
+        const auto & aind = a.colInd();
+        for (size_t i = t*m_rows/num_row_tasks; i < (t+1)*m_rows/num_row_tasks; i++)
+          {
+            size_t sum = 0;
+            for (size_t ka = a.first(i); ka < a.next(i); ka++)
+              sum += b.next(aind[ka]) - b.first(aind[ka]);
+            m_flops[i] = sum;
+          }
+      });
+      std::vector<size_t> flopsptr(m_flops);
+      ParallelPrefixSum (flopsptr);
+      const size_t total = flopsptr[m_rows];
+
+      const size_t num_tasks = std::max<size_t>(1, std::min(total / SPARSE_GRAIN, m_rows));
+      m_part.resize(num_tasks+1);
+      m_part[0] = 0;
+      for (size_t t = 1; t < num_tasks; t++)
+        {
+          size_t pos = std::lower_bound(flopsptr.begin(), flopsptr.end(), t*total/num_tasks) - flopsptr.begin();
+          m_part[t] = std::max(m_part[t-1], std::min(pos, m_rows));
+        }
+      m_part[num_tasks] = m_rows;
+
+      // symbolic merge into private buffers
+      std::vector<std::vector<size_t>> buffers(num_tasks);
+      ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+      {
+        auto & buf = buffers[t];
+        std::vector<size_t> marker;     // dense: row stamp i+1 per column
+        std::vector<size_t> table;      // hash: column or EMPTY
+
+        for (size_t i = m_part[t]; i < m_part[t+1]; i++)
+          {
+            const size_t first = buf.size();
+            if (useDense(i))
+              {
+                if (marker.empty()) marker.assign(m_cols, 0);
+                forRowProducts (a, b, i, [&](size_t j, T)
+                {
+                  if (marker[j] != i+1)
+                    {
+                      marker[j] = i+1;
+                      buf.push_back(j);
+                    }
+                });
+              }
+            else
+              {
+                const size_t size = hashSize(m_flops[i]), mask = size-1;
+                if (table.size() < size) table.resize(size);
+                std::fill (table.begin(), table.begin()+size, EMPTY);
+                forRowProducts (a, b, i, [&](size_t j, T)
+                {
+                  size_t h = hash(j, mask);
+                  while (table[h] != EMPTY && table[h] != j)
+                    h = (h+1) & mask;
+                  if (table[h] == EMPTY)
+                    {
+                      table[h] = j;
+                      buf.push_back(j);
+                    }
+                });
+              }
+            std::sort (buf.begin()+first, buf.end());
+            m_rowptr[i] = buf.size()-first;
+          }
+      });
+
+      ParallelPrefixSum (m_rowptr);
+      m_colind.resize(m_rowptr[m_rows]);
+      ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+      {
+        std::copy (buffers[t].begin(), buffers[t].end(), m_colind.begin()+m_rowptr[m_part[t]]);
+      });
+    }
+
+    size_t rows() const { return m_rows; }
+    size_t cols() const { return m_cols; }
+    size_t nnz() const { return m_colind.size(); }
+
+    // C = A B with a new matrix C
+    SparseMatrix<T> multiply (const SparseMatrix<T> & a, const SparseMatrix<T> & b) const
+    {
+      SparseMatrix<T> c(m_rows, m_cols, m_rowptr, m_colind, std::vector<T>(nnz()));
+      multiply (a, b, c);
+      return c;
+    }
+
+    // values of C = A B, C has the pattern of the symbolic product
+    void multiply (const SparseMatrix<T> & a, const SparseMatrix<T> & b, SparseMatrix<T> & c) const
+    {
+      checkShapes (a, b);
+      if (c.rows() != m_rows || c.cols() != m_cols || c.nnz() != nnz())
+        throw std::invalid_argument("SparseProduct::multiply: C does not have the product pattern");
+
+      // a pattern changed behind the hash check must neither hang nor
+      // write out of bounds, the tasks report it instead of throwing
+      auto & cval = c.values();
+      const size_t num_tasks = m_part.size()-1;
+      std::vector<char> failed(num_tasks, false);
+      ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+      {
+        std::vector<T> dense;           // dense accumulator, zero outside the current row
+        std::vector<size_t> table;      // hash keys
+        std::vector<T> tvals;           // hash values
+
+        for (size_t i = m_part[t]; i < m_part[t+1]; i++)
+          {
+            const size_t k1 = m_rowptr[i], k2 = m_rowptr[i+1];
+            if (useDense(i))
+              {
+                if (dense.empty()) dense.assign(m_cols, T(0));
+                forRowProducts (a, b, i, [&](size_t j, T v) { dense[j] += v; });
+                for (size_t k = k1; k < k2; k++)
+                  cval[k] = dense[m_colind[k]];
+                // every touched column, not only the pattern of C
+                forRowProducts (a, b, i, [&](size_t j, T) { dense[j] = T(0); });
+              }
+            else
+              {
+                const size_t size = hashSize(m_flops[i]), mask = size-1;
+                if (table.size() < size)
+                  {
+                    table.resize(size);
+                    tvals.resize(size);
+                  }
+                std::fill (table.begin(), table.begin()+size, EMPTY);
+                size_t count = 0;
+                forRowProducts (a, b, i, [&](size_t j, T v)
+                {
+                  if (++count > m_flops[i]) return;     // the table would fill up
+                  size_t h = hash(j, mask);
+                  while (table[h] != EMPTY && table[h] != j)
+                    h = (h+1) & mask;
+                  if (table[h] == EMPTY)
+                    {
+                      table[h] = j;
+                      tvals[h] = v;
+                    }
+                  else
+                    tvals[h] += v;
+                });
+                if (count > m_flops[i])
+                  {
+                    failed[t] = true;
+                    return;
+                  }
+                for (size_t k = k1; k < k2; k++)
+                  {
+                    size_t h = hash(m_colind[k], mask);
+                    while (table[h] != EMPTY && table[h] != m_colind[k])
+                      h = (h+1) & mask;
+                    if (table[h] == EMPTY)
+                      {
+                        failed[t] = true;
+                        return;
+                      }
+                    cval[k] = tvals[h];
+                  }
+              }
+          }
+      });
+
+      if (std::any_of (failed.begin(), failed.end(), [](char f) { return f; }))
+        throw std::invalid_argument("SparseProduct::multiply: pattern of A B does not match the symbolic product");
+    }
+  };
+
+
+  // C = A B, for a single product (use SparseProduct to reuse the pattern)
+  template <typename T>
+  SparseMatrix<T> MultSparseSparse (const SparseMatrix<T> & a, const SparseMatrix<T> & b)
+  {
+    return SparseProduct<T>(a, b).multiply(a, b);
+  }
+
+}
+
+#endif
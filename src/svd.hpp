@@ -0,0 +1,82 @@
+#ifndef FILE_SVD_HPP
+#define FILE_SVD_HPP
+
+#include <random>
+#include <algorithm>
+
+#include "lapack_interface.hpp"
+
+
+namespace nanoblas
+{
+
+  // rank-k factors  A ~ U diag(S) V^T
+  struct LowRankSVD
+  {
+    Matrix<double,ColMajor> U;     // m x k
+    Vector<double> S;              // k, descending
+    Matrix<double,ColMajor> Vt;    // k x n
+  };
+
+
+  /*
+    Randomized SVD (Halko, Martinsson, Tropp):
+
+      range finder:     Y = A Omega,  Omega n x (k+p) Gaussian,  Q = orth(Y)
+      power iteration:  Q = orth(A orth(A^T Q))   (sharpens slowly decaying spectra)
+      small SVD:        B = Q^T A = Ub S Vt,  U = Q Ub
+
+    Only A times thin blocks is needed (dgemm through MultMatMatLapack),
+    orthonormalization uses the LAPACK QR. The dense decomposition is
+    only computed for the (k+p) x n matrix B.
+  */
+  template <ORDERING ORD>
+  LowRankSVD RandomizedSVD (MatrixView<double,ORD> A, size_t k,
+                            size_t oversampling = 10, size_t power_iterations = 2,
+                            unsigned seed = 42)
+  {
+    const size_t m = A.rows();
+    const size_t n = A.cols();
+    const size_t l = std::min(k + oversampling, std::min(m, n));
+    k = std::min(k, l);
+
+    std::mt19937 gen(seed);
+    std::normal_distribution<double> normal(0.0, 1.0);
+
+    Matrix<double,ColMajor> omega(n, l);
+    for (size_t j = 0; j < l; j++)
+      for (size_t i = 0; i < n; i++)
+        omega(i,j) = normal(gen);
+
+    Matrix<double,ColMajor> Y(m, l);
+    MultMatMatLapack (A, MatrixView<double,ColMajor>(omega), MatrixView<double,ColMajor>(Y));
+    Matrix<double,ColMajor> Q = LapackQR(MatrixView<double,ColMajor>(Y)).Q();
+
+    Matrix<double,ColMajor> Z(n, l);
+    for (size_t it = 0; it < power_iterations; it++)
+      {
+        MultMatMatLapack (trans(A), MatrixView<double,ColMajor>(Q), MatrixView<double,ColMajor>(Z));
+        Matrix<double,ColMajor> QZ = LapackQR(MatrixView<double,ColMajor>(Z)).Q();
+        MultMatMatLapack (A, MatrixView<double,ColMajor>(QZ), MatrixView<double,ColMajor>(Y));
+        Q = LapackQR(MatrixView<double,ColMajor>(Y)).Q();
+      }
+
+    // B = Q^T A
+    Matrix<double,ColMajor> B(l, n);
+    MultMatMatLapack (trans(MatrixView<double,ColMajor>(Q)), A, MatrixView<double,ColMajor>(B));
+    LapackSVD svd { MatrixView<double,ColMajor>(B) };
+
+    // U = Q Ub
+    Matrix<double,ColMajor> U(m, l);
+    MultMatMatLapack (MatrixView<double,ColMajor>(Q), svd.U(), MatrixView<double,ColMajor>(U));
+
+    LowRankSVD res { Matrix<double,ColMajor>(m, k), Vector<double>(k), Matrix<double,ColMajor>(k, n) };
+    res.U = U.cols(0, k);
+    res.S = svd.S().range(0, k);
+    res.Vt = svd.Vt().rows(0, k);
+    return res;
+  }
+
+}
+
+#endif
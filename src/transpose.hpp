@@ -0,0 +1,189 @@
+#ifndef FILE_TRANSPOSE_HPP
+#define FILE_TRANSPOSE_HPP
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "matrix.hpp"
+
+
+namespace nanoblas
+{
+
+  /*
+    Physical transposes and layout conversion.
+
+      Transpose (A, B)          B = A^T, copied
+      TransposeInPlace (A)      A = A^T for square A
+      ..._parallel              the same, distributed over the workers
+
+    MatrixView::operator= between the two orderings uses Transpose
+    (serial, it may be called inside parallel tasks).
+
+    The raw kernels work on row-wise arrays, b[j*ldb+i] = a[i*lda+j].
+    They halve the larger dimension recursively (cache oblivious) down
+    to 64 x 64 leaves, whose source lines stay in L1 while the leaf is
+    written column by column in contiguous runs.
+  */
+
+
+  template <typename T>
+  void TransposeLeaf (const T * a, size_t lda, T * b, size_t ldb, size_t rows, size_t cols)
+  {
+    for (size_t j = 0; j < cols; j++)
+      {
+        T * bj = b + j*ldb;
+        for (size_t i = 0; i < rows; i++)
+          bj[i] = a[i*lda+j];
+      }
+  }
+
+  // b[j*ldb+i] = a[i*lda+j],  i < rows, j < cols
+  template <typename T>
+  void TransposeRaw (const T * a, size_t lda, T * b, size_t ldb, size_t rows, size_t cols)
+  {
+    constexpr size_t LEAF = 64;
+    if (rows <= LEAF && cols <= LEAF)
+      {
+        TransposeLeaf (a, lda, b, ldb, rows, cols);
+        return;
+      }
+
+    // split at a multiple of 8, leaves start at cache line boundaries
+    if (rows >= cols)
+      {
+        const size_t r1 = std::max<size_t>(8, rows/2 / 8 * 8);
+        TransposeRaw (a, lda, b, ldb, r1, cols);
+        TransposeRaw (a+r1*lda, lda, b+r1, ldb, rows-r1, cols);
+      }
+    else
+      {
+        const size_t c1 = std::max<size_t>(8, cols/2 / 8 * 8);
+        TransposeRaw (a, lda, b, ldb, rows, c1);
+        TransposeRaw (a+c1, lda, b+c1*ldb, ldb, rows, cols-c1);
+      }
+  }
+
+  // the larger dimension is split into one strip per task
+  template <typename T>
+  void TransposeRaw_parallel (const T * a, size_t lda, T * b, size_t ldb, size_t rows, size_t cols)
+  {
+    constexpr size_t GRAIN = 1 << 18;     // entries per task
+    const size_t nlong = std::max(rows, cols);
+    const size_t num_tasks = std::clamp<size_t>(rows*cols / GRAIN, 1, std::min<size_t>(64, (nlong+7)/8));
+
+    ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+    {
+      const size_t first = t*nlong/num_tasks / 8 * 8;
+      const size_t next = (t+1 == int(num_tasks)) ? nlong : (t+1)*nlong/num_tasks / 8 * 8;
+      if (rows >= cols)
+        TransposeRaw (a+first*lda, lda, b+first, ldb, next-first, cols);
+      else
+        TransposeRaw (a+first, lda, b+first*ldb, ldb, rows, next-first);
+    });
+  }
+
+
+  // ************************* MatrixView interface *******************
+
+  // B = A^T: the same orderings transpose the memory, different orderings copy it
+  template <typename T, ORDERING OA, ORDERING OB>
+  void Transpose (MatrixView<T,OA> A, MatrixView<T,OB> B)
+  {
+    assert(A.rows() == B.cols() && A.cols() == B.rows());
+    if constexpr (OA != OB)
+      B = trans(A);
+    else if constexpr (OA == RowMajor)
+      TransposeRaw (A.data(), A.dist(), B.data(), B.dist(), A.rows(), A.cols());
+    else
+      TransposeRaw (A.data(), A.dist(), B.data(), B.dist(), A.cols(), A.rows());
+  }
+
+  template <typename T, ORDERING OA, ORDERING OB>
+  void Transpose_parallel (MatrixView<T,OA> A, MatrixView<T,OB> B)
+  {
+    assert(A.rows() == B.cols() && A.cols() == B.rows());
+    if constexpr (OA != OB)
+      {
+        const size_t n = B.rows();
+        const size_t num_tasks = std::clamp<size_t>(n*B.cols() / (1 << 18), 1, std::min<size_t>(64, n));
+        ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+        {
+          const size_t first = t*n/num_tasks, next = (t+1)*n/num_tasks;
+          B.rows(first, next) = trans(A).rows(first, next);
+        });
+      }
+    else if constexpr (OA == RowMajor)
+      TransposeRaw_parallel (A.data(), A.dist(), B.data(), B.dist(), A.rows(), A.cols());
+    else
+      TransposeRaw_parallel (A.data(), A.dist(), B.data(), B.dist(), A.cols(), A.rows());
+  }
+
+
+  /*
+    A = A^T for square A. The matrix is split into TILE x TILE tiles,
+    tile (I,J) and tile (J,I) are exchanged through a buffer, a
+    diagonal tile is transposed within the buffer.
+  */
+  template <typename T, ORDERING ORD>
+  void TransposeInPlaceTiles (MatrixView<T,ORD> A, size_t first, size_t next)
+  {
+    constexpr size_t TILE = 32;
+    const size_t n = A.rows();
+    const size_t nb = (n + TILE - 1) / TILE;
+    T * a = A.data();
+    const size_t lda = A.dist();
+    T buffer[TILE*TILE];
+
+    // pair p -> tiles (I,J), J >= I, row by row of the upper block triangle
+    size_t I = 0, rowstart = 0;
+    while (rowstart + (nb-I) <= first) { rowstart += nb-I; I++; }
+    size_t J = I + (first - rowstart);
+
+    for (size_t p = first; p < next; p++)
+      {
+        const size_t i1 = I*TILE, ni = std::min(TILE, n-i1);
+        const size_t j1 = J*TILE, nj = std::min(TILE, n-j1);
+        T * aIJ = a + i1*lda + j1;
+        T * aJI = a + j1*lda + i1;
+
+        // buffer = tile(I,J), tile(I,J) = tile(J,I)^T, tile(J,I) = buffer^T
+        for (size_t i = 0; i < ni; i++)
+          for (size_t j = 0; j < nj; j++)
+            buffer[i*TILE+j] = aIJ[i*lda+j];
+        if (I != J)
+          TransposeRaw (aJI, lda, aIJ, lda, nj, ni);
+        TransposeRaw (buffer, TILE, aJI, lda, ni, nj);
+
+        if (++J == nb) { I++; J = I; }
+      }
+  }
+
+  template <typename T, ORDERING ORD>
+  void TransposeInPlace (MatrixView<T,ORD> A)
+  {
+    if (A.rows() != A.cols())
+      throw std::invalid_argument("TransposeInPlace: matrix must be square");
+    const size_t nb = (A.rows() + 31) / 32;
+    TransposeInPlaceTiles (A, 0, nb*(nb+1)/2);
+  }
+
+  template <typename T, ORDERING ORD>
+  void TransposeInPlace_parallel (MatrixView<T,ORD> A)
+  {
+    if (A.rows() != A.cols())
+      throw std::invalid_argument("TransposeInPlace: matrix must be square");
+    constexpr size_t GRAIN = 128;     // tile pairs per task
+    const size_t nb = (A.rows() + 31) / 32;
+    const size_t num_pairs = nb*(nb+1)/2;
+    const size_t num_tasks = std::clamp<size_t>(num_pairs / GRAIN, 1, 64);
+
+    ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+    {
+      TransposeInPlaceTiles (A, t*num_pairs/num_tasks, (t+1)*num_pairs/num_tasks);
+    });
+  }
+
+}
+
+#endif
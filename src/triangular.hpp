@@ -0,0 +1,248 @@
+#ifndef FILE_TRIANGULAR_HPP
+#define FILE_TRIANGULAR_HPP
+
+#include <algorithm>
+
+#include "vector.hpp"
+#include "matrix.hpp"
+
+
+namespace nanoblas
+{
+
+  /*
+    Triangular solves  A x = b  (TRSV)  and  A X = B  (TRSM),
+    b resp. B overwritten with the solution.
+
+      TriangularSolve<Lower, NonUnit> (A, B)
+
+    Only the triangle UPLO of A is referenced, with DIAG == Unit the
+    diagonal is assumed to be 1 and not referenced. Systems with A^T
+    are solved with the view trans(A) and the other triangle, e.g.
+    TriangularSolve<Upper>(trans(L), b) for L^T x = b.
+  */
+
+  enum TRIANGLE { Lower, Upper };
+  enum DIAGTYPE { NonUnit, Unit };
+
+  constexpr size_t TRSM_BLOCKSIZE = 96;
+
+
+  // ************************* TRSV *******************
+
+  // loop order by ordering: dot products along rows (RowMajor), axpys along columns (ColMajor)
+  template <TRIANGLE UPLO, DIAGTYPE DIAG = NonUnit, typename T, ORDERING ORD, typename TDIST>
+  void TriangularSolve (MatrixView<T,ORD> A, VectorView<T,TDIST> b)
+  {
+    assert(A.rows() == A.cols() && A.rows() == b.size());
+    const size_t n = A.rows();
+
+    if constexpr (UPLO == Lower && ORD == RowMajor)
+      for (size_t i = 0; i < n; i++)
+        {
+          T sum = b(i);
+          for (size_t j = 0; j < i; j++)
+            sum -= A(i,j) * b(j);
+          b(i) = (DIAG == Unit) ? sum : sum / A(i,i);
+        }
+
+    else if constexpr (UPLO == Lower && ORD == ColMajor)
+      for (size_t j = 0; j < n; j++)
+        {
+          T xj = (DIAG == Unit) ? b(j) : b(j) / A(j,j);
+          b(j) = xj;
+          for (size_t i = j+1; i < n; i++)
+            b(i) -= A(i,j) * xj;
+        }
+
+    else if constexpr (UPLO == Upper && ORD == RowMajor)
+      for (size_t i = n; i-- > 0; )
+        {
+          T sum = b(i);
+          for (size_t j = i+1; j < n; j++)
+            sum -= A(i,j) * b(j);
+          b(i) = (DIAG == Unit) ? sum : sum / A(i,i);
+        }
+
+    else
+      for (size_t j = n; j-- > 0; )
+        {
+          T xj = (DIAG == Unit) ? b(j) : b(j) / A(j,j);
+          b(j) = xj;
+          for (size_t i = 0; i < j; i++)
+            b(i) -= A(i,j) * xj;
+        }
+  }
+
+
+  // ************************* TRSM *******************
+
+  // C -= P^T B for ColMajor P (K x M), B (K x N), C (M x N): dot products
+  // along the contiguous columns of P and B, 4 x 2 of them at a time
+  template <typename T>
+  void SubTransMatMat (MatrixView<T,ColMajor> P, MatrixView<T,ColMajor> B, MatrixView<T,ColMajor> C)
+  {
+    const size_t K = P.rows(), M = P.cols(), N = B.cols();
+    auto pcol = [&](size_t i) { return P.data() + i*P.dist(); };
+    auto bcol = [&](size_t j) { return B.data() + j*B.dist(); };
+
+    size_t j = 0;
+    for ( ; j+2 <= N; j += 2)
+      {
+        const T * b0 = bcol(j), * b1 = bcol(j+1);
+        size_t i = 0;
+        for ( ; i+4 <= M; i += 4)
+          {
+            const T * p[4] = { pcol(i), pcol(i+1), pcol(i+2), pcol(i+3) };
+            T s0[4] = { 0, 0, 0, 0 }, s1[4] = { 0, 0, 0, 0 };
+            for (size_t k = 0; k < K; k++)
+              for (size_t r = 0; r < 4; r++)
+                {
+                  s0[r] += p[r][k] * b0[k];
+                  s1[r] += p[r][k] * b1[k];
+                }
+            for (size_t r = 0; r < 4; r++)
+              {
+                C(i+r, j) -= s0[r];
+                C(i+r, j+1) -= s1[r];
+              }
+          }
+        for ( ; i < M; i++)
+          {
+            const T * pi = pcol(i);
+            T s0 = 0, s1 = 0;
+            for (size_t k = 0; k < K; k++)
+              {
+                s0 += pi[k] * b0[k];
+                s1 += pi[k] * b1[k];
+              }
+            C(i, j) -= s0;
+            C(i, j+1) -= s1;
+          }
+      }
+    for ( ; j < N; j++)
+      for (size_t i = 0; i < M; i++)
+        {
+          const T * pi = pcol(i), * bj = bcol(j);
+          T sum = 0;
+          for (size_t k = 0; k < K; k++)
+            sum += pi[k] * bj[k];
+          C(i, j) -= sum;
+        }
+  }
+
+
+  /*
+    Blocked solve of op(A) X = B for ColMajor A and X, op(A) = A or,
+    with TRANSA, A^T (read in place, e.g. L^T from a Cholesky factor).
+    The diagonal blocks of size TRSM_BLOCKSIZE are solved column by
+    column, the remaining rows of X are updated by GEMM (addMatMat,
+    resp. SubTransMatMat for A^T) with the off-diagonal panel, which
+    is where almost all of the flops are.
+  */
+  template <TRIANGLE UPLO, DIAGTYPE DIAG, bool TRANSA = false, typename T>
+  void TriangularSolveColMajor (MatrixView<T,ColMajor> A, MatrixView<T,ColMajor> X)
+  {
+    constexpr TRIANGLE OTHER = (UPLO == Lower) ? Upper : Lower;
+    constexpr bool forward = (UPLO == Lower) != TRANSA;    // op(A) lower triangular
+    const size_t n = A.rows();
+    const size_t ncols = X.cols();
+    Matrix<T,ColMajor> negX(TRSM_BLOCKSIZE, ncols);
+
+    auto solveDiagBlock = [&](size_t k1, size_t k2)
+    {
+      auto D = A.rows(k1,k2).cols(k1,k2);
+      for (size_t c = 0; c < ncols; c++)
+        if constexpr (TRANSA)
+          TriangularSolve<OTHER,DIAG> (trans(D), X.col(c).range(k1,k2));
+        else
+          TriangularSolve<UPLO,DIAG> (D, X.col(c).range(k1,k2));
+    };
+
+    // negX = -X(k1..k2,:)
+    auto negate = [&](size_t k1, size_t k2)
+    {
+      auto nx = negX.rows(0, k2-k1);
+      for (size_t c = 0; c < ncols; c++)
+        for (size_t i = k1; i < k2; i++)
+          nx(i-k1, c) = -X(i,c);
+      return nx;
+    };
+
+    if constexpr (forward)
+      for (size_t k1 = 0; k1 < n; k1 += TRSM_BLOCKSIZE)
+        {
+          const size_t k2 = std::min(n, k1 + TRSM_BLOCKSIZE);
+          solveDiagBlock (k1, k2);
+          if (k2 < n)
+            {
+              if constexpr (TRANSA)
+                SubTransMatMat (A.rows(k1, k2).cols(k2, n), X.rows(k1, k2), X.rows(k2, n));
+              else
+                addMatMat (A.rows(k2, n).cols(k1, k2), negate(k1, k2), X.rows(k2, n));
+            }
+        }
+    else
+      for (size_t k2 = n; k2 > 0; )
+        {
+          const size_t k1 = (k2 > TRSM_BLOCKSIZE) ? k2 - TRSM_BLOCKSIZE : 0;
+          solveDiagBlock (k1, k2);
+          if (k1 > 0)
+            {
+              if constexpr (TRANSA)
+                SubTransMatMat (A.rows(k1, k2).cols(0, k1), X.rows(k1, k2), X.rows(0, k1));
+              else
+                addMatMat (A.rows(0, k1).cols(k1, k2), negate(k1, k2), X.rows(0, k1));
+            }
+          k2 = k1;
+        }
+  }
+
+
+  /*
+    A X = B, B overwritten with X. The columns of B are distributed
+    over the workers in chunks; a RowMajor A is solved as the
+    transpose of the ColMajor view trans(A), without a copy. RowMajor
+    chunks of B are solved in a ColMajor copy.
+  */
+  template <TRIANGLE UPLO, DIAGTYPE DIAG = NonUnit, typename T, ORDERING OA, ORDERING OB>
+  void TriangularSolve (MatrixView<T,OA> A, MatrixView<T,OB> B)
+  {
+    assert(A.rows() == A.cols() && A.rows() == B.rows());
+    const size_t n = A.rows();
+    const size_t ncols = B.cols();
+    if (n == 0 || ncols == 0) return;
+
+    // solves one ColMajor block of right hand sides
+    auto solveColMajor = [&](MatrixView<T,ColMajor> X)
+    {
+      if constexpr (OA == ColMajor)
+        TriangularSolveColMajor<UPLO,DIAG> (A, X);
+      else
+        TriangularSolveColMajor<(UPLO == Lower) ? Upper : Lower, DIAG, true> (trans(A), X);
+    };
+
+    constexpr size_t GRAIN = 48;   // columns per task
+    const size_t num_tasks = (ncols + GRAIN - 1) / GRAIN;
+
+    ASC_HPC::RunParallel(static_cast<int>(num_tasks), [&](int t, int /*ntasks*/)
+    {
+      const size_t j1 = static_cast<size_t>(t) * GRAIN;
+      const size_t j2 = std::min(ncols, j1 + GRAIN);
+      auto Bsub = B.cols(j1, j2);
+
+      if constexpr (OB == ColMajor)
+        solveColMajor (Bsub);
+      else
+        {
+          Matrix<T,ColMajor> X(n, j2-j1);
+          X = Bsub;
+          solveColMajor (X);
+          Bsub = X;
+        }
+    });
+  }
+
+}
+
+#endif